@@ -1,3 +1,4 @@
+#define _DEFAULT_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <memory.h>
@@ -7,74 +8,286 @@
 #include <netdb.h>
 #include <zconf.h>
 #include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <stdint.h>
+#include <signal.h>
+#include <sys/stat.h>
 
 ////Global variables and constants
 #define MAX_CHARACTER_LENGTH    100000
+#define MAX_ENDPOINTS           16          //max number of daemons that can be listed in the port argument
+#define MAX_ATTEMPTS            6           //total tries across all endpoints before giving up
+#define BACKOFF_BASE_MS         20          //first retry waits up to this long, doubling each attempt
+#define BACKOFF_CAP_MS          1000        //upper bound on a single retry wait
+#define LEASE_FILE              "otp_dec.leases"    //in $XDG_RUNTIME_DIR, else /tmp with the user id added
+#define LEASE_SLOTS             1024        //requests in flight on this machine that the shared table can track
 char plaintext[MAX_CHARACTER_LENGTH];
 char key[MAX_CHARACTER_LENGTH];
 char ciphertext[MAX_CHARACTER_LENGTH];
 
+//one daemon the client may talk to
+struct Endpoint {
+    char host[256];
+    long port;
+    struct sockaddr_in address;     //resolved once, reused for every reconnect
+    int isResolved;
+    int isDisabled;                 //set when the daemon is not otp_dec_d; never retried
+    int failures;
+};
+struct Endpoint endpoints[MAX_ENDPOINTS];
+int endpointCount = 0;
+
+//requests in flight, shared by every otp_dec process on this machine through a small mmap'd file so concurrent
+//clients can see each other's load. each request holds a lease, (pid << 32) | endpoint hash, 0 for a free slot.
+//a lease whose process is gone is freed by whoever comes across it, so a killed client can't skew the counts
+//for good. falls back to process-local leases.
+uint64_t localLeases[LEASE_SLOTS];
+uint64_t *leases = localLeases;
+
 ////Helper functions
 //function prototoypes to avoid implicit declaration issues
-int EstablishConnection(long listenPort);
+void ParseEndpoints(char *);
+void OpenLeaseTable();
+unsigned int EndpointHash(struct Endpoint *);
+int IsLeaseStale(uint64_t);
+int CountInFlight(struct Endpoint *);
+uint64_t* TakeLease(struct Endpoint *);
+void ReleaseLease(uint64_t *);
+int PickEndpoint(int);
+void Backoff(int);
+int EstablishConnection(struct Endpoint *);
+int SendAll(int, char *, size_t);
+int RecvAll(int, char *, size_t);
 void ValidFileCheck(char*, char*);
-void RequestDecryption(int socketFD);
+int RequestDecryption(int socketFD);
 
 
-//sets up client address and connects to address at given user port
-int EstablishConnection(long listenPort) {
-    //create listen socket
-    int listenSocket = socket(AF_INET, SOCK_STREAM, 0);
-    if (listenSocket == -1) {
-        fprintf(stderr,"Client: Error creating listen socket.");
-        exit(EXIT_FAILURE);
+//parses port argument into endpoint list. format: "port" or "[host:]port,[host:]port,..." (default host: localhost)
+void ParseEndpoints(char *portList) {
+    char *ptr;
+    char *entry = strtok(portList, ",");
+    while (entry != NULL) {
+        if (endpointCount == MAX_ENDPOINTS) {
+            fprintf(stderr,"Client: Too many endpoints given, only the first %d are used.\n", MAX_ENDPOINTS);
+            break;
+        }
+        struct Endpoint *endpoint = &endpoints[endpointCount];
+        memset(endpoint, 0, sizeof(struct Endpoint));
+
+        //split off optional host
+        char *portString = strrchr(entry, ':');
+        if (portString != NULL) {
+            *portString = '\0';
+            portString++;
+            strncpy(endpoint->host, entry, sizeof(endpoint->host) - 1);
+        }
+        else {
+            portString = entry;
+            strcpy(endpoint->host, "localhost");
+        }
+
+        //convert port to number and check it's a valid integer
+        errno = 0;
+        endpoint->port = strtol(portString, &ptr, 10);
+        if (errno != 0 || ptr == portString || endpoint->port <= 0 || endpoint->port > 65535) {
+            fprintf(stderr,"Client: Invalid port entered");
+            exit(EXIT_FAILURE);
+        }
+
+        endpointCount++;
+        entry = strtok(NULL, ",");
     }
 
-    //get IP address of sever (default: localhost)
-    struct hostent* serverHostInfo = gethostbyname("localhost");
-    if (serverHostInfo == NULL) {
-        fprintf(stderr,"Client: Cannot resolve hostname server address for listen socket.");
+    if (endpointCount == 0) {
+        fprintf(stderr,"Client: Invalid port entered");
         exit(EXIT_FAILURE);
     }
+}
 
-    //setup port address of server
-    struct sockaddr_in serverAddress;
-    serverAddress.sin_family = AF_INET;
-    serverAddress.sin_port = htons(listenPort);
+//maps the shared lease file, which belongs to the user: it is in their runtime directory when there is one, else
+//in /tmp under a name with their user id. a symlink, or anything but a regular file only the user can use, is
+//refused, so nobody can point the client at another file to write into. if anything goes wrong just keep the
+//process-local leases
+void OpenLeaseTable() {
+    char fileName[512];
+    char *runtimeDirectory = getenv("XDG_RUNTIME_DIR");
+    if (runtimeDirectory != NULL && runtimeDirectory[0] == '/')
+        snprintf(fileName, sizeof(fileName), "%s/"LEASE_FILE, runtimeDirectory);
+    else
+        snprintf(fileName, sizeof(fileName), "/tmp/"LEASE_FILE".%d", (int) getuid());
+
+    int fileDescriptor = open(fileName, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (fileDescriptor == -1)
+        return;
+    struct stat fileStat;
+    if (fstat(fileDescriptor, &fileStat) == -1 || !S_ISREG(fileStat.st_mode) || fileStat.st_uid != getuid() ||
+        (fileStat.st_mode & 077) != 0) {
+        close(fileDescriptor);
+        return;
+    }
 
-    memcpy((char*)&serverAddress.sin_addr.s_addr,
-           serverHostInfo->h_addr_list[0], serverHostInfo->h_length);
+    size_t tableSize = LEASE_SLOTS * sizeof(uint64_t);
+    if (ftruncate(fileDescriptor, tableSize) == 0) {
+        void *table = mmap(NULL, tableSize, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+        if (table != MAP_FAILED)
+            leases = (uint64_t*) table;
+    }
+    close(fileDescriptor);
+}
 
-    //connecting socket to server (localhost)
-    int connectStatus = connect(listenSocket, (struct sockaddr*) &serverAddress, sizeof(serverAddress));
+//hash of the endpoint's host and port, which its leases carry
+unsigned int EndpointHash(struct Endpoint *endpoint) {
+    unsigned int hash = (unsigned int) endpoint->port;
+    for (char *c = endpoint->host; *c != '\0'; c++)
+        hash = hash * 31 + (unsigned char) *c;
+    return hash;
+}
+
+//true if the process holding the lease no longer exists
+int IsLeaseStale(uint64_t lease) {
+    pid_t pid = (pid_t) (lease >> 32);
+    return kill(pid, 0) == -1 && errno == ESRCH;
+}
+
+//number of live leases on the endpoint. stale ones met on the way are freed
+int CountInFlight(struct Endpoint *endpoint) {
+    unsigned int hash = EndpointHash(endpoint);
+    int count = 0;
+    for (int i = 0; i < LEASE_SLOTS; i++) {
+        uint64_t lease = __atomic_load_n(&leases[i], __ATOMIC_RELAXED);
+        if (lease == 0 || (unsigned int) lease != hash)
+            continue;
+        if (IsLeaseStale(lease))
+            __atomic_compare_exchange_n(&leases[i], &lease, 0, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+        else
+            count++;
+    }
+    return count;
+}
+
+//takes a free (or stale) slot for a request to the endpoint. returns NULL if the table is full of live leases,
+//then the request just isn't counted
+uint64_t* TakeLease(struct Endpoint *endpoint) {
+    uint64_t lease = ((uint64_t) getpid() << 32) | EndpointHash(endpoint);
+    for (int i = 0; i < LEASE_SLOTS; i++) {
+        uint64_t current = __atomic_load_n(&leases[i], __ATOMIC_RELAXED);
+        if (current != 0 && !IsLeaseStale(current))
+            continue;
+        if (__atomic_compare_exchange_n(&leases[i], &current, lease, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            return &leases[i];
+    }
+    return NULL;
+}
+
+//gives the slot back once the request is over
+void ReleaseLease(uint64_t *slot) {
+    if (slot != NULL)
+        __atomic_store_n(slot, 0, __ATOMIC_RELAXED);
+}
+
+//power-of-two-choices: sample two usable endpoints at random and take the one with fewer requests in flight.
+//avoid is the index that just failed; it is skipped whenever there is anything else left to try
+int PickEndpoint(int avoid) {
+    int candidates[MAX_ENDPOINTS];
+    int candidateCount = 0;
+    for (int i = 0; i < endpointCount; i++) {
+        if (!endpoints[i].isDisabled && i != avoid)
+            candidates[candidateCount++] = i;
+    }
+    if (candidateCount == 0)
+        return (avoid >= 0 && !endpoints[avoid].isDisabled) ? avoid : -1;
+    if (candidateCount == 1)
+        return candidates[0];
+
+    //second draw is over the other candidates so the two choices are always distinct
+    int firstIndex = rand() % candidateCount;
+    int secondIndex = rand() % (candidateCount - 1);
+    if (secondIndex >= firstIndex)
+        secondIndex++;
+    int first = candidates[firstIndex];
+    int second = candidates[secondIndex];
+
+    int firstLoad = CountInFlight(&endpoints[first]);
+    int secondLoad = CountInFlight(&endpoints[second]);
+    if (firstLoad != secondLoad)
+        return (firstLoad < secondLoad) ? first : second;
+
+    //tie: prefer the one that has failed less
+    return (endpoints[second].failures < endpoints[first].failures) ? second : first;
+}
+
+//sleeps a random amount between 0 and an exponentially growing cap ("full jitter") before the next attempt
+void Backoff(int attempt) {
+    long capMs = BACKOFF_BASE_MS << attempt;
+    if (capMs > BACKOFF_CAP_MS)
+        capMs = BACKOFF_CAP_MS;
+    long waitMs = rand() % (capMs + 1);
+
+    struct timespec wait;
+    wait.tv_sec = waitMs / 1000;
+    wait.tv_nsec = (waitMs % 1000) * 1000000;
+    nanosleep(&wait, NULL);
+}
+
+//connects to the endpoint and verifies its identity.
+//returns the connected socket, -1 on failure (endpoint gets disabled if the server is not otp_dec_d)
+int EstablishConnection(struct Endpoint *endpoint) {
+    //get IP address of sever only once per endpoint
+    if (!endpoint->isResolved) {
+        struct hostent* serverHostInfo = gethostbyname(endpoint->host);
+        if (serverHostInfo == NULL) {
+            fprintf(stderr,"Client: Cannot resolve hostname server address '%s'.\n", endpoint->host);
+            return -1;
+        }
+
+        //setup port address of server
+        memset(&endpoint->address, 0, sizeof(endpoint->address));
+        endpoint->address.sin_family = AF_INET;
+        endpoint->address.sin_port = htons(endpoint->port);
+        memcpy((char*)&endpoint->address.sin_addr.s_addr,
+               serverHostInfo->h_addr_list[0], serverHostInfo->h_length);
+        endpoint->isResolved = 1;
+    }
+
+    //create listen socket
+    int listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenSocket == -1) {
+        fprintf(stderr,"Client: Error creating listen socket.");
+        return -1;
+    }
+
+    //connecting socket to server
+    int connectStatus = connect(listenSocket, (struct sockaddr*) &endpoint->address, sizeof(endpoint->address));
     if (connectStatus == -1) {
-        fprintf(stderr,"Client: Cannot connect socket to server.' port.");
-        exit(EXIT_FAILURE);
+        close(listenSocket);
+        return -1;
     }
 
-//    printf("Client: Connected to server at port %d\n", ntohs(serverAddress.sin_port));
+//    printf("Client: Connected to server at port %d\n", ntohs(endpoint->address.sin_port));
 
-    //send own identity to otp_enc_d via own program name
+    //send own identity to otp_dec_d via own program name
     char programName[15];
     memset(programName, '\0', sizeof(programName));
     strcpy(programName, "otp_dec");
-    int sendIdentity = (int) send(listenSocket, programName, sizeof(programName), 0);
-    if (sendIdentity == -1)
+    if (SendAll(listenSocket, programName, sizeof(programName)) == -1) {
         fprintf(stderr,"Client: error writing identity to socket.");
-    if (sendIdentity < strlen(programName))
-        fprintf(stderr,"Client: not all of identity written to socket.");
+        close(listenSocket);
+        return -1;
+    }
 
-    //receive identity from otp_enc_d for verification
+    //receive identity from otp_dec_d for verification
+    //a daemon of the wrong kind hangs up instead of answering, which leaves programName empty below
     memset(programName, '\0', sizeof(programName));
-    int receiveIdentity = (int) recv(listenSocket, programName, sizeof(programName), 0);
-    if (receiveIdentity == -1)
-        fprintf(stderr,"Client: error reading identity from socket.");
+    RecvAll(listenSocket, programName, sizeof(programName));
 
-    //compare identity; disconnect if it's not otp_enc_d
+    //compare identity; disconnect and never use this endpoint again if it's not otp_dec_d
+    programName[sizeof(programName) - 1] = '\0';
     if (strcmp(programName, "otp_dec_d") != 0) {
-        fprintf(stderr, "Client: server at port %d is not otp_dec_d.\n", ntohs(serverAddress.sin_port));
+        fprintf(stderr, "Client: server at port %d is not otp_dec_d.\n", ntohs(endpoint->address.sin_port));
         close(listenSocket);
-        exit(2);
+        endpoint->isDisabled = 1;
+        return -1;
     }
 //    else
 //        printf("Client: identity of server otp_dec_d safely established.\n");
@@ -82,6 +295,34 @@ int EstablishConnection(long listenPort) {
     return listenSocket;
 }
 
+//send() until every byte is out. returns 0 on success, -1 on error
+int SendAll(int socketFD, char *buffer, size_t length) {
+    size_t sent = 0;
+    while (sent < length) {
+        ssize_t count = send(socketFD, buffer + sent, length - sent, MSG_NOSIGNAL);
+        if (count == -1 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return -1;
+        sent += count;
+    }
+    return 0;
+}
+
+//recv() until the buffer is filled. returns 0 on success, -1 on error or if the peer closed early
+int RecvAll(int socketFD, char *buffer, size_t length) {
+    size_t received = 0;
+    while (received < length) {
+        ssize_t count = recv(socketFD, buffer + received, length - received, 0);
+        if (count == -1 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return -1;
+        received += count;
+    }
+    return 0;
+}
+
 //opens parameter file, checks for bad characters, and process them into strings
 void ValidFileCheck(char* ciphertextFile, char* keyFile) {
     memset(ciphertext, '\0', MAX_CHARACTER_LENGTH);
@@ -145,7 +386,8 @@ void ValidFileCheck(char* ciphertextFile, char* keyFile) {
 }
 
 //sends the ciphertext and key to server (otp_dec_d), and stores received plaintext in array
-void RequestDecryption(int socketFD) {
+//returns 0 on success, -1 if the connection broke and the request should be retried elsewhere
+int RequestDecryption(int socketFD) {
     //establish and send value of length - this saves time so receive doesn't read max buffer of array
     long textLength = strlen(ciphertext);
     char strLength[10];
@@ -153,36 +395,36 @@ void RequestDecryption(int socketFD) {
     sprintf(strLength, "%ld", textLength); //convert long to string
 
     //send length value
-    int sendLength = (int) send(socketFD, strLength, sizeof(strLength), 0);
-    if (sendLength == -1)
+    if (SendAll(socketFD, strLength, sizeof(strLength)) == -1) {
         fprintf(stderr,"Client: error writing length to socket.");
-    if (sendLength < sizeof(strLength))
-        fprintf(stderr,"Client: not all of length written to socket.");
+        return -1;
+    }
 
     //send ciphertext
-    int sendciphertext = (int) send(socketFD, ciphertext, (size_t) textLength, 0);
-    if (sendciphertext == -1)
+    if (SendAll(socketFD, ciphertext, (size_t) textLength) == -1) {
         fprintf(stderr,"Client: error writing ciphertext to socket.");
-    if (sendciphertext < strlen(ciphertext))
-        fprintf(stderr,"Client: not all of ciphertext written to socket.");
+        return -1;
+    }
 
     //send key
-    int sendKey = (int) send(socketFD, key, (size_t) textLength, 0);
-    if (sendKey == -1)
+    if (SendAll(socketFD, key, (size_t) textLength) == -1) {
         fprintf(stderr,"Client: error writing key to socket.");
-    if (sendKey < strlen(key))
-        fprintf(stderr,"Client: not all of key written to socket.");
+        return -1;
+    }
 
     //receive plaintext
-    memset(plaintext, '\0', sizeof(ciphertext));
-    int receiverplaintext = (int) recv(socketFD, plaintext, (size_t) textLength, 0);
-    if (receiverplaintext == -1)
+    memset(plaintext, '\0', sizeof(plaintext));
+    if (RecvAll(socketFD, plaintext, (size_t) textLength) == -1) {
         fprintf(stderr,"Client: error reading plaintext from socket.");
+        return -1;
+    }
+
+    return 0;
 }
 
 
 ////Acts as client. Sends to server ciphertext/key and gets & outputs corresponding plaintext
-//format: otp_dec ciphertext key port
+//format: otp_dec ciphertext key port[,port...]  (each entry may also be host:port)
 int main(int argc, char *argv[]) {
     //checks if it's in the correct format of "otp_dec <ciphertext> <key> <server port>"
     if (argc != 4) {
@@ -193,25 +435,49 @@ int main(int argc, char *argv[]) {
     //check ciphertext and key files for any bad characters and process them as strings
     ValidFileCheck(argv[1], argv[2]);
 
-    //convert port int and store as number
-    char *ptr;
-    long listenPort;
-    errno = 0;
-    listenPort = strtol(argv[3], &ptr, 10);
-    if (errno != 0 && listenPort == 0) { //check valid integer entered
-        fprintf(stderr,"Client: Invalid port entered");
-        exit(EXIT_FAILURE);
-    }
+    //parse one or more daemon endpoints, then attach to the shared leases
+    ParseEndpoints(argv[3]);
+    OpenLeaseTable();
+    srand((unsigned int) (time(0) ^ getpid()));
+
+    //picks a daemon and sends ciphertext and key to be decrypted; on error fails over to another daemon after a backoff
+    int isDone = 0;
+    int lastFailed = -1;
+    for (int attempt = 0; attempt < MAX_ATTEMPTS && !isDone; attempt++) {
+        if (attempt > 0)
+            Backoff(attempt - 1);
+
+        int target = PickEndpoint(lastFailed);
+        if (target == -1)
+            break; //every endpoint is disabled
+        struct Endpoint *endpoint = &endpoints[target];
+
+        uint64_t *lease = TakeLease(endpoint);
+
+        int socketFD = EstablishConnection(endpoint);
+        if (socketFD != -1 && RequestDecryption(socketFD) == 0)
+            isDone = 1;
+        else {
+            endpoint->failures++;
+            lastFailed = target;
+        }
+        if (socketFD != -1)
+            close(socketFD);
 
-    //creates connection to given port on localhost (server)
-    int socketFD = EstablishConnection(listenPort);
+        ReleaseLease(lease);
+    }
 
-    //sends ciphertext and key to be encrpyted
-    RequestDecryption(socketFD);
+    //all attempts failed; exit 2 if the servers we did reach were the wrong kind
+    if (!isDone) {
+        int isAnyDisabled = 0;
+        for (int i = 0; i < endpointCount; i++)
+            isAnyDisabled |= endpoints[i].isDisabled;
+        fprintf(stderr,"Client: Cannot connect socket to server.' port.");
+        exit(isAnyDisabled ? 2 : EXIT_FAILURE);
+    }
 
     //prints processed plaintext to stdout
     printf("%s\n", plaintext);
 
-    close(socketFD);
     return 0;
 }
\ No newline at end of file
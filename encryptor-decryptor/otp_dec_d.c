@@ -19,7 +19,9 @@ char ciphertext[MAX_CHARACTER_LENGTH];
 //function prototoypes to avoid implicit declaration issues
 int SetupListenSocket(long listenPort);
 void AcceptConnections(int listenSocket);
-void ProcessDecryption(int establishedConnectionFD);
+int ProcessDecryption(int establishedConnectionFD);
+int SendAll(int, char *, size_t);
+int RecvAll(int, char *, size_t);
 void ProcessPlainText();
 int ConvertToDec(char character);
 
@@ -153,37 +155,76 @@ void ProcessPlainText() {
     }
 }
 
-void ProcessDecryption(int establishedConnectionFD) {
+//receives one request (length, ciphertext, key) and replies with the plaintext.
+//returns 0 when done, -1 when the connection broke or the request was bad
+int ProcessDecryption(int establishedConnectionFD) {
     //receive length of text and convert to long
     char strLength[10];
     memset(strLength, '\0', sizeof(strLength));
-    int receiveLength = (int) recv(establishedConnectionFD, strLength, sizeof(strLength), 0);
-    if (receiveLength == -1)
+    if (RecvAll(establishedConnectionFD, strLength, sizeof(strLength)) == -1) {
         fprintf(stderr,"Server: error reading length from socket.");
+        return -1;
+    }
+    strLength[sizeof(strLength) - 1] = '\0';
     char *ptr;
     long textLength = strtol(strLength, &ptr, 10);
+    if (textLength < 0 || textLength >= MAX_CHARACTER_LENGTH) {
+        fprintf(stderr,"Server: invalid length read from socket.");
+        return -1;
+    }
 
     //receive ciphertext
     memset(ciphertext, '\0', MAX_CHARACTER_LENGTH);
-    int receiveCipherText = (int) recv(establishedConnectionFD, ciphertext, (size_t) textLength, 0);
-    if (receiveCipherText == -1)
+    if (RecvAll(establishedConnectionFD, ciphertext, (size_t) textLength) == -1) {
         fprintf(stderr,"Server: error reading ciphertext from socket.");
+        return -1;
+    }
 
     //receive key
     memset(key, '\0', MAX_CHARACTER_LENGTH);
-    int receiveKey = (int) recv(establishedConnectionFD, key, (size_t) textLength, 0);
-    if (receiveKey == -1)
+    if (RecvAll(establishedConnectionFD, key, (size_t) textLength) == -1) {
         fprintf(stderr,"Server: error reading key from socket.");
+        return -1;
+    }
 
     //process ciphertext to plaintext
     ProcessPlainText();
 
     //send plaintext to client
-    int sendPlaintext = (int) send(establishedConnectionFD, plaintext, (size_t) strlen(plaintext), 0);
-    if (sendPlaintext == -1)
+    if (SendAll(establishedConnectionFD, plaintext, (size_t) strlen(plaintext)) == -1) {
         fprintf(stderr,"Server: error writing plaintext to socket.");
-    if (sendPlaintext < strlen(ciphertext))
-        fprintf(stderr,"Server: not all of plaintext written to socket.");
+        return -1;
+    }
+
+    return 0;
+}
+
+//send() until every byte is out. returns 0 on success, -1 on error
+int SendAll(int socketFD, char *buffer, size_t length) {
+    size_t sent = 0;
+    while (sent < length) {
+        ssize_t count = send(socketFD, buffer + sent, length - sent, MSG_NOSIGNAL);
+        if (count == -1 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return -1;
+        sent += count;
+    }
+    return 0;
+}
+
+//recv() until the buffer is filled. returns 0 on success, -1 on error or if the peer closed early
+int RecvAll(int socketFD, char *buffer, size_t length) {
+    size_t received = 0;
+    while (received < length) {
+        ssize_t count = recv(socketFD, buffer + received, length - received, 0);
+        if (count == -1 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return -1;
+        received += count;
+    }
+    return 0;
 }
 
 
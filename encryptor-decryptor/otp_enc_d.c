@@ -19,7 +19,9 @@ char ciphertext[MAX_CHARACTER_LENGTH];
 //function prototoypes to avoid implicit declaration issues
 int SetupListenSocket(long listenPort);
 void AcceptConnections(int listenSocket);
-void ProcessEncryption(int establishedConnectionFD);
+int ProcessEncryption(int establishedConnectionFD);
+int SendAll(int, char *, size_t);
+int RecvAll(int, char *, size_t);
 void ProcessCipherText();
 int ConvertToDec(char character);
 
@@ -149,37 +151,76 @@ void ProcessCipherText() {
     }
 }
 
-void ProcessEncryption(int establishedConnectionFD) {
+//receives one request (length, plaintext, key) and replies with the ciphertext.
+//returns 0 when done, -1 when the connection broke or the request was bad
+int ProcessEncryption(int establishedConnectionFD) {
     //receive length of text and convert to long
     char strLength[10];
     memset(strLength, '\0', sizeof(strLength));
-    int receiveLength = (int) recv(establishedConnectionFD, strLength, sizeof(strLength), 0);
-    if (receiveLength == -1)
-        fprintf(stderr, "Server: error reading length from socket.");
+    if (RecvAll(establishedConnectionFD, strLength, sizeof(strLength)) == -1) {
+        fprintf(stderr,"Server: error reading length from socket.");
+        return -1;
+    }
+    strLength[sizeof(strLength) - 1] = '\0';
     char *ptr;
     long textLength = strtol(strLength, &ptr, 10);
+    if (textLength < 0 || textLength >= MAX_CHARACTER_LENGTH) {
+        fprintf(stderr,"Server: invalid length read from socket.");
+        return -1;
+    }
 
     //receive plaintext
     memset(plaintext, '\0', MAX_CHARACTER_LENGTH);
-    int receivePlaintext = (int) recv(establishedConnectionFD, plaintext, (size_t) textLength, 0);
-    if (receivePlaintext == -1)
-        fprintf(stderr, "Server: error reading plaintext from socket.");
+    if (RecvAll(establishedConnectionFD, plaintext, (size_t) textLength) == -1) {
+        fprintf(stderr,"Server: error reading plaintext from socket.");
+        return -1;
+    }
 
     //receive key
     memset(key, '\0', MAX_CHARACTER_LENGTH);
-    int receiveKey = (int) recv(establishedConnectionFD, key, (size_t) textLength, 0);
-    if (receiveKey == -1)
-        fprintf(stderr, "Server: error reading key from socket.");
+    if (RecvAll(establishedConnectionFD, key, (size_t) textLength) == -1) {
+        fprintf(stderr,"Server: error reading key from socket.");
+        return -1;
+    }
 
     //process ciphertext
     ProcessCipherText();
 
     //send ciphertext to client
-    int sendCiphertext = (int) send(establishedConnectionFD, ciphertext, (size_t) strlen(ciphertext), 0);
-    if (sendCiphertext == -1)
-        fprintf(stderr, "Server: error writing ciphertext to socket.");
-    if (sendCiphertext < strlen(ciphertext))
-        fprintf(stderr, "Server: not all of ciphertext written to socket.");
+    if (SendAll(establishedConnectionFD, ciphertext, (size_t) strlen(ciphertext)) == -1) {
+        fprintf(stderr,"Server: error writing ciphertext to socket.");
+        return -1;
+    }
+
+    return 0;
+}
+
+//send() until every byte is out. returns 0 on success, -1 on error
+int SendAll(int socketFD, char *buffer, size_t length) {
+    size_t sent = 0;
+    while (sent < length) {
+        ssize_t count = send(socketFD, buffer + sent, length - sent, MSG_NOSIGNAL);
+        if (count == -1 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return -1;
+        sent += count;
+    }
+    return 0;
+}
+
+//recv() until the buffer is filled. returns 0 on success, -1 on error or if the peer closed early
+int RecvAll(int socketFD, char *buffer, size_t length) {
+    size_t received = 0;
+    while (received < length) {
+        ssize_t count = recv(socketFD, buffer + received, length - received, 0);
+        if (count == -1 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return -1;
+        received += count;
+    }
+    return 0;
 }
 
 ////Acts as server. Waits for connection to receive plaintext/key, encrpyts, and sends ciphertext
@@ -0,0 +1,249 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/types.h>
+
+////Global variables and constants
+#define DEFAULT_COUNT       2000        //commands timed per workload
+#define WARMUP_COUNT        50          //commands run before timing starts, to fill caches
+#define PROMPT_TIMEOUT_MS   10000       //give up if the shell doesn't answer within this long
+#define READ_BUFFER_SIZE    4096
+
+//one kind of command the harness times
+struct Workload {
+    char *name;
+    char *command;                      //line sent to the shell, without the newline
+};
+
+struct Workload workloads[] = {
+    {"blank", ""},                      //prompt + read only
+    {"builtin", "true"},                //parse + in-shell command
+    {"exec", "/bin/true"},              //parse + launch + wait
+    {"redirect", "/bin/echo hi > /dev/null"},
+    {"pipeline", "/bin/true | /bin/true"},
+    {"background", "/bin/true &"},      //launch without wait; completions show up as extra output
+    {NULL, NULL}
+};
+
+char *shellPath = "./smallsh";          //shell under test
+int commandCount = DEFAULT_COUNT;
+char *onlyWorkload = NULL;              //-w: time just this workload
+char *launchMethods[2] = {"spawn", "fork"}; //values of SMALLSH_LAUNCH to compare
+int launchMethodCount = 1;              //-c compares both
+long long *latencies;                   //nanoseconds per command of the current workload
+
+
+////Helper Functions
+//declare function prototypes to avoid implicit compiler issues
+int StartShell(char*, pid_t*);
+int WaitForPrompt(int);
+int SendCommand(int, char*);
+void StopShell(int, pid_t);
+long long Now();
+int CompareLatency(const void*, const void*);
+void RunWorkload(int, struct Workload*, char*);
+
+
+//starts the shell on a new pseudo-terminal with echo turned off, so the only output is the shell's own.
+//returns the master side of the terminal, -1 on error
+int StartShell(char *launchMethod, pid_t *shellPid) {
+    int masterFD = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (masterFD == -1 || grantpt(masterFD) == -1 || unlockpt(masterFD) == -1) {
+        perror("shbench: cannot open a pseudo-terminal");
+        return -1;
+    }
+
+    *shellPid = fork();
+    if (*shellPid == -1) {
+        perror("shbench: fork");
+        return -1;
+    }
+    if (*shellPid == 0) {
+        setsid();
+        int slaveFD = open(ptsname(masterFD), O_RDWR);
+        if (slaveFD == -1) {
+            perror("shbench: cannot open terminal");
+            exit(EXIT_FAILURE);
+        }
+        struct termios settings;
+        tcgetattr(slaveFD, &settings);
+        settings.c_lflag &= ~(ECHO | ECHONL);
+        tcsetattr(slaveFD, TCSANOW, &settings);
+
+        dup2(slaveFD, STDIN_FILENO);
+        dup2(slaveFD, STDOUT_FILENO);
+        dup2(slaveFD, STDERR_FILENO);
+        if (slaveFD > STDERR_FILENO)
+            close(slaveFD);
+
+        setenv("SMALLSH_LAUNCH", launchMethod, 1);
+        execl(shellPath, shellPath, (char*) NULL);
+        perror("shbench: cannot run the shell");
+        exit(EXIT_FAILURE);
+    }
+
+    if (WaitForPrompt(masterFD) == -1) {
+        StopShell(masterFD, *shellPid);
+        return -1;
+    }
+    return masterFD;
+}
+
+//reads the shell's output until it ends with the ": " prompt. returns -1 on timeout or if the shell is gone
+int WaitForPrompt(int masterFD) {
+    char buffer[READ_BUFFER_SIZE];
+    char last[2] = {0, 0}; //last two characters read so far
+    struct pollfd readable = {masterFD, POLLIN, 0};
+
+    while (1) {
+        int ready = poll(&readable, 1, PROMPT_TIMEOUT_MS);
+        if (ready == -1 && errno == EINTR)
+            continue;
+        if (ready <= 0) {
+            fprintf(stderr, "shbench: no prompt from the shell\n");
+            return -1;
+        }
+
+        ssize_t count = read(masterFD, buffer, sizeof(buffer));
+        if (count == -1 && errno == EINTR)
+            continue;
+        if (count <= 0) {
+            fprintf(stderr, "shbench: shell closed the terminal\n");
+            return -1;
+        }
+
+        if (count >= 2) {
+            last[0] = buffer[count - 2];
+            last[1] = buffer[count - 1];
+        }
+        else {
+            last[0] = last[1];
+            last[1] = buffer[0];
+        }
+        if (last[0] == ':' && last[1] == ' ')
+            return 0;
+    }
+}
+
+//types one command line into the shell
+int SendCommand(int masterFD, char *command) {
+    char line[READ_BUFFER_SIZE];
+    int length = snprintf(line, sizeof(line), "%s\n", command);
+    return (write(masterFD, line, length) == length) ? 0 : -1;
+}
+
+//asks the shell to exit and reaps it, killing it if it doesn't go
+void StopShell(int masterFD, pid_t shellPid) {
+    SendCommand(masterFD, "exit");
+    for (int i = 0; i < 100; i++) {
+        if (waitpid(shellPid, NULL, WNOHANG) == shellPid) {
+            close(masterFD);
+            return;
+        }
+        usleep(10000);
+    }
+    kill(shellPid, SIGKILL);
+    waitpid(shellPid, NULL, 0);
+    close(masterFD);
+}
+
+//monotonic clock in nanoseconds
+long long Now() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long) now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+int CompareLatency(const void *a, const void *b) {
+    long long left = *(const long long*) a, right = *(const long long*) b;
+    return (left > right) - (left < right);
+}
+
+//times commandCount round trips (command sent until the next prompt) of one workload and prints
+//the latency percentiles and the commands per second
+void RunWorkload(int masterFD, struct Workload *workload, char *launchMethod) {
+    for (int i = 0; i < WARMUP_COUNT; i++) {
+        if (SendCommand(masterFD, workload->command) == -1 || WaitForPrompt(masterFD) == -1)
+            return;
+    }
+
+    long long start = Now();
+    for (int i = 0; i < commandCount; i++) {
+        long long sent = Now();
+        if (SendCommand(masterFD, workload->command) == -1 || WaitForPrompt(masterFD) == -1)
+            return;
+        latencies[i] = Now() - sent;
+    }
+    double seconds = (Now() - start) / 1e9;
+
+    qsort(latencies, commandCount, sizeof(long long), CompareLatency);
+    printf("%-6s %-11s %8.1f %8.1f %8.1f %8.1f %10.0f\n", launchMethod, workload->name,
+           latencies[commandCount / 2] / 1e3, latencies[commandCount * 90 / 100] / 1e3,
+           latencies[commandCount * 99 / 100] / 1e3, latencies[commandCount - 1] / 1e3,
+           commandCount / seconds);
+    fflush(stdout);
+}
+
+
+////Drives smallsh through a pseudo-terminal, the way a user would, and times each command until the next prompt
+//usage: shbench [-n count] [-s shell] [-w workload] [-c]
+//  -n  commands timed per workload (default 2000)
+//  -s  shell to test (default ./smallsh)
+//  -w  run only this workload (blank, builtin, exec, redirect, pipeline, background)
+//  -c  compare the posix_spawn and fork launch paths (SMALLSH_LAUNCH)
+int main(int argc, char *argv[]) {
+    int option;
+    while ((option = getopt(argc, argv, "n:s:w:c")) != -1) {
+        switch (option) {
+            case 'n':
+                commandCount = atoi(optarg);
+                break;
+            case 's':
+                shellPath = optarg;
+                break;
+            case 'w':
+                onlyWorkload = optarg;
+                break;
+            case 'c':
+                launchMethodCount = 2;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n count] [-s shell] [-w workload] [-c]\n", argv[0]);
+                exit(2);
+        }
+    }
+    if (commandCount < 1) {
+        fprintf(stderr, "shbench: count must be at least 1\n");
+        exit(2);
+    }
+
+    latencies = (long long*) malloc(commandCount * sizeof(long long));
+    printf("%-6s %-11s %8s %8s %8s %8s %10s\n", "launch", "workload", "p50 us", "p90 us", "p99 us", "max us", "cmds/s");
+
+    for (int m = 0; m < launchMethodCount; m++) {
+        for (int w = 0; workloads[w].name != NULL; w++) {
+            if (onlyWorkload != NULL && strcmp(onlyWorkload, workloads[w].name) != 0)
+                continue;
+
+            //fresh shell per workload so background jobs of one don't disturb the next
+            pid_t shellPid;
+            int masterFD = StartShell(launchMethods[m], &shellPid);
+            if (masterFD == -1)
+                exit(EXIT_FAILURE);
+            RunWorkload(masterFD, &workloads[w], launchMethods[m]);
+            StopShell(masterFD, shellPid);
+        }
+    }
+
+    free(latencies);
+    return 0;
+}
\ No newline at end of file
@@ -1,4 +1,4 @@
-#define _XOPEN_SOURCE
+#define _GNU_SOURCE
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,135 +8,797 @@
 #include <fcntl.h>
 #include <sys/wait.h>
 #include <sys/types.h>
+#include <sys/signalfd.h>
+#include <poll.h>
+#include <spawn.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+#include <limits.h>
+#include <dirent.h>
+#include <fnmatch.h>
 
 ////Global variables and constants
-#define MAX_CMD_LENGTH      2048
-#define MAX_ARGS            512
-#define BG_PID_SIZE         100         //size of bgPid array
+#define PARSE_MIN_SIZE      64          //initial size of the parser's arrays; they double as longer lines come in
+#define JOB_TABLE_MIN_SIZE  64          //initial slots in the background job table; doubles as it fills
+#define PIPE_SIZE_ENV       "SMALLSH_PIPE_SIZE" //optional pipe buffer size in bytes, applied with F_SETPIPE_SZ
+#define LAUNCH_ENV          "SMALLSH_LAUNCH"    //"fork" forces the fork()+execvp() launch path
+#define PATH_CACHE_MIN_SIZE 64          //initial slots in the command path cache; doubles as it fills
+#define DIR_CACHE_MIN_SIZE  16          //initial slots in the glob directory listing cache; doubles as it fills
+#define GLOB_BLOCK_SIZE     65536       //minimum size of a block of glob match storage
+#define ARG_MAX_HEADROOM    4096        //bytes of ARG_MAX left unused, for the kernel's own bookkeeping
+#define SCRIPT_READ_CHUNK   (1 << 20)   //read() size when a script can't be mmap'd (pipes, /dev/stdin, ...)
+#define PARALLEL_MAX_STATUS 101         //"parallel" exits with the number of failed jobs, capped like GNU parallel
+#define LAUNCH_SPAWN        0
+#define LAUNCH_FORK         1
 
-char commandPrompt[MAX_CMD_LENGTH];     //string to hold user input commands
+char* commandPrompt;                    //string to hold user input commands; grows to fit the longest line
+size_t commandPromptSize;               //bytes allocated for commandPrompt
 char blank[] = "___blank";              //workaround to avoid some crazy seg fault for blank lines and SIGTSTP..
-char** commandArgs;                     //pointer to parsed command prompts
-int bgPid[BG_PID_SIZE];                 //storage for background processes
-char shellPid[10];                      //container for $$ expansion
+char** commandArgs;                     //words of every stage, each stage's argv ending with a NULL; reused per line
+int commandArgsSize;                    //slots allocated for commandArgs
+char* wordArena;                        //text of every word of the current line (quotes removed, $$ expanded)
+size_t wordArenaSize;                   //bytes allocated for wordArena; reused per line, grows to fit
+char* patternBuffer;                    //current word as a glob pattern: like the word, with quoted *?[]\ escaped
+
+//one redirection of a pipeline stage: "<", ">", ">>", "2>", "2>>", "2>&1" or "<<<" ("&>" is "> file 2>&1")
+struct Redirection {
+    int targetFD;                       //0, 1 or 2: which of the command's streams it replaces
+    int type;                           //REDIRECT_READ, _WRITE, _APPEND, _DUP or _HERE
+    char *fileName;                     //file, or the text of a here-string; points into wordArena
+};
+#define REDIRECT_READ       0           //< file
+#define REDIRECT_WRITE      1           //> file, 2> file
+#define REDIRECT_APPEND     2           //>> file, 2>> file
+#define REDIRECT_DUP        3           //2>&1: whatever stdout is at that point
+#define REDIRECT_HERE       4           //<<< text, fed through a pipe (or a memfd if it doesn't fit)
+
+//one command of the parsed line; a plain command is a pipeline with one stage
+struct Stage {
+    int argStart;                       //index in commandArgs of the stage's first word
+    int argsCount;                      //words in the stage (redirections not included)
+    int redirectStart;                  //index in redirections of the stage's first redirection
+    int redirectCount;                  //redirections of the stage, applied in order
+};
+struct Stage* stages;                   //stages of the current line, in pipeline order
+int stagesSize;                         //slots allocated for stages
+struct Redirection* redirections;       //redirections of every stage of the current line
+int redirectionsSize;                   //slots allocated for redirections
+int redirectionsCount;                  //redirections used by the current line
+//resources used by a job, from wait4(). for a pipeline the stages are added up (max for the RSS)
+struct JobUsage {
+    struct timespec wallTime;           //launch until reaped
+    struct timeval userTime;
+    struct timeval systemTime;
+    long maxRss;                        //kilobytes
+    long voluntarySwitches;
+    long involuntarySwitches;
+};
+
+//background process record. pid 0 marks an empty slot in the job table, -1 a deleted one
+struct Job {
+    pid_t pid;
+    struct timespec startTime;          //CLOCK_MONOTONIC at launch
+    int isTimed;                        //launched with "time": report usage when it finishes
+};
+
+struct Job* jobTable;                   //background processes: open-addressing hash table keyed by pid
+int jobTableSize;                       //slots in jobTable, always a power of 2
+int jobTableUsed;                       //live jobs + deleted markers, kept under 3/4 of jobTableSize
+int sigchldFD;                          //signalfd that becomes readable when a child changes state
+char shellPid[12];                      //container for $$ expansion
+size_t shellPidLength;
 int argsCount;                          //counter of arguments in user input
 int isBackgroundTask = 0;               //fast way to identify and check for background
 int exitStatus;                         //exit status captured by shell upon child termination
 int isTermBySignal;                     //evaluates whether foreground process terminated by signal, otherwise normal.
 int isBackgroundEnabled = 1;            //toggles background processes, default is enabled
+int stageCount;                         //number of pipeline stages in user input, 1 for a plain command
+int pipeBufferSize = 0;                 //0 leaves pipes at the kernel's default size
+int isScriptMode = 0;                   //commands come from a script file or -c string: no prompts
+char* scriptText;                       //whole script, mmap'd or read in large chunks; not NUL terminated
+size_t scriptLength;                    //bytes in scriptText
+size_t scriptOffset;                    //start of the next line to run
+int isEndOfInput = 0;                   //set by UserInput() once there are no more commands
+int isTimedTask = 0;                    //command was prefixed with "time"
+struct timespec launchTime;             //when the current command was launched
+struct JobUsage lastUsage;              //resources of the last foreground command, for "status -v"
+struct rusage shellStartUsage;          //the shell's own rusage when the current in-shell command started
+struct rusage childrenStartUsage;       //rusage of the shell's reaped children at that time
+int isChildExitPending = 0;             //SIGCHLD notifications were drained by "parallel" before background jobs were reaped
+int launchMethod = LAUNCH_SPAWN;        //how external commands are started, see LaunchCommand()
+sigset_t childSignalMask;               //signal mask the shell started with, restored in children
+posix_spawnattr_t spawnAttrForeground;  //child signal setup for posix_spawn: SIGINT default, normal mask
+posix_spawnattr_t spawnAttrBackground;  //same, but SIGINT stays ignored like in the shell
+
+//remembered location of a command found on PATH (like bash's "hash")
+struct CommandPath {
+    char *name;                         //NULL for an empty slot
+    char *path;                         //absolute path found on PATH, NULL once forgotten
+    int hits;                           //times this entry was used to launch the command
+};
+struct CommandPath* pathCache;          //open-addressing hash table keyed by command name
+int pathCacheSize;                      //slots in pathCache, always a power of 2
+int pathCacheCount;                     //slots with a name in them
+char* pathCacheFor;                     //value of PATH the cache was filled with
+
+//one name in a directory listing
+struct DirectoryEntry {
+    char *name;
+    unsigned char type;                 //d_type (DT_UNKNOWN if the file system doesn't say)
+};
+
+//sorted names in a directory, kept for globbing until the directory changes
+struct DirectoryListing {
+    char *path;                         //directory as given to opendir(), NULL for an empty slot
+    dev_t device;                       //identity and mtime the listing was read at; a cd to another
+    ino_t inode;                        //directory with the same relative path, or any file created
+    struct timespec modified;           //or removed in it, makes the listing stale
+    struct DirectoryEntry *entries;     //sorted by name, "." and ".." left out
+    int count;
+    char *nameBlob;                     //storage for the names
+};
+struct DirectoryListing* dirCache;      //open-addressing hash table keyed by directory path
+int dirCacheSize;                       //slots in dirCache, always a power of 2
+int dirCacheCount;                      //slots with a path in them
+
+//storage for glob matches of the current line: blocks are kept and reused from line to line
+struct GlobBlock {
+    struct GlobBlock *next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+struct GlobBlock* globBlocks;           //first block; the chain only grows
+struct GlobBlock* globCurrent;          //block matches are being added to
+long argMaxBytes;                       //room for argv strings and pointers in exec, from ARG_MAX minus the environment
+
+//utility commands run inside the shell instead of being launched, see RunUtilityBuiltin()
+typedef int (*BuiltinFunction)(int, char**);
+int CommandEcho(int, char**);
+int CommandTrue(int, char**);
+int CommandFalse(int, char**);
+int CommandTest(int, char**);
+int CommandPwd(int, char**);
+int CommandPrintf(int, char**);
+struct UtilityBuiltin {
+    char *name;
+    BuiltinFunction run;                //takes argc/argv like main(), returns the exit status
+} utilityBuiltins[] = {
+    {"echo", CommandEcho}, {"true", CommandTrue}, {"false", CommandFalse}, {"test", CommandTest},
+    {"[", CommandTest}, {"pwd", CommandPwd}, {"printf", CommandPrintf}, {NULL, NULL}
+};
 
 
 ////Helper Functions
 //declare function prototypes to avoid implicit compiler issues
 void UserInput();
+int ScriptInput();
+void LoadScript(char*);
 void ParseCommandPrompt();
+void ParseError(char*);
+void* GrowArray(void*, int*, int, size_t);
 void CommandExit();
 void CommandCd();
 void CommandStatus();
-void ChildExecute(pid_t);
-void ManageRedirection();
-void ProcessHandler(pid_t);
+void CommandHash();
+void CommandParallel();
+char** ParallelJobArgs(char**, int, char*);
+void ParallelFinish(pid_t, int, int, int*);
+BuiltinFunction FindUtilityBuiltin(char*);
+void RunUtilityBuiltin(BuiltinFunction);
+int RedirectShell(int*);
+void RestoreShell(int*);
+int TestUnary(char*, char*);
+int TestBinary(char*, char*, char*);
+char* PrintfEscape(char*);
+void PathCacheClear();
+struct CommandPath* PathCacheSlot(char*);
+void ForgetCommandPath(char*);
+char* LookupCommandPath(char*);
+void ChildExecute(char**, char*, int*);
+int ManageRedirection(struct Stage*, int*, int*);
+void AddRedirection(int, int, char*);
+int HereString(char*);
+pid_t LaunchCommand(char**, int*);
+int ExpandGlob(char*);
+void GlobDirectory(char*, size_t, char*);
+void AddGlobMatch(char*);
+struct DirectoryListing* ReadDirectory(char*);
+struct DirectoryListing* DirCacheSlot(char*);
+int CompareEntries(const void*, const void*);
+void ExecutePipeline();
+void ProcessHandler(pid_t*, int);
 void CheckBGProcesses();
+void JobTableInit(int);
+void JobAdd(struct Job);
+int JobRemove(pid_t, struct Job*);
+void AddUsage(struct JobUsage*, struct rusage*);
+void SetWallTime(struct JobUsage*, struct timespec*);
+void PrintUsage(struct JobUsage*);
+void StartShellCommand();
+void FinishShellCommand(int);
 void CatchStopSigForBackgroundToggle(int);
 
 
 //takes input from the user, format as string, and update global commandPrompt array
 void UserInput() {
-    fflush(stdout);
+    //script mode: next line straight out of the script buffer, no prompt
+    if (isScriptMode) {
+        if (ScriptInput() == -1) {
+            isEndOfInput = 1;
+            commandPrompt[0] = '\0';
+        }
+        return;
+    }
+
     printf(": "); //prompt for command line
     fflush(stdout);
 
-    char *endP;
-    memset(commandPrompt, '\0', MAX_CMD_LENGTH);
-    //takes input, checks stdin and exits early if there's issue
-    if(fgets(commandPrompt, MAX_CMD_LENGTH, stdin) != NULL) {
+    //at a terminal, wait for input and child exits together so background completions show up right away
+    if (isatty(STDIN_FILENO)) {
+        struct pollfd waitFDs[2] = {{STDIN_FILENO, POLLIN, 0}, {sigchldFD, POLLIN, 0}};
+        while (poll(waitFDs, 2, -1) > 0 && !(waitFDs[0].revents & (POLLIN | POLLHUP))) {
+            printf("\n");
+            CheckBGProcesses();
+            printf(": ");
+            fflush(stdout);
+        }
+    }
+
+    //takes input of any length, checks stdin and exits early if there's issue
+    ssize_t lineLength = getline(&commandPrompt, &commandPromptSize, stdin);
+    if (lineLength != -1) {
         //converts the stdin's newline to null terminator for string
-        endP = strstr(commandPrompt, "\n");
-        if (endP != NULL)
-            *endP = '\0';
+        if (lineLength > 0 && commandPrompt[lineLength - 1] == '\n')
+            commandPrompt[lineLength - 1] = '\0';
     }
-    else { //fgets is null when any signals come in during this. Clear prompt, which will be treated as blank
-        memset(commandPrompt, '\0', MAX_CMD_LENGTH);
+    else { //getline fails at end of input or when any signals come in during this. Clear prompt, treated as blank
+        commandPrompt[0] = '\0';
+        if (feof(stdin)) {
+            isEndOfInput = 1;
+            return;
+        }
+        clearerr(stdin);
     }
+}
 
-    //checks if it's background task, and record it as such
-    isBackgroundTask = 0; //default
+//copies the next line of the script into commandPrompt. returns -1 once the script is used up
+int ScriptInput() {
+    if (scriptOffset >= scriptLength)
+        return -1;
 
-    //printf("the char 2nd from end is: '%c', and last is '%c'\n", commandPrompt[strlen(commandPrompt)-2], commandPrompt[strlen(commandPrompt)-1]);
+    char *line = scriptText + scriptOffset;
+    size_t remaining = scriptLength - scriptOffset;
+    char *endP = (char*) memchr(line, '\n', remaining);
+    size_t lineLength = (endP != NULL) ? (size_t) (endP - line) : remaining;
+    scriptOffset += lineLength + 1;
 
-    if (commandPrompt[strlen(commandPrompt)-1] == '&' && commandPrompt[strlen(commandPrompt)-2] == ' ') {
-        isBackgroundTask = 1;
-        //remove " &" from args now that flag is set
-        commandPrompt[strlen(commandPrompt)-1] = '\0';
-        commandPrompt[strlen(commandPrompt)-1] = '\0';
+    if (lineLength + 1 > commandPromptSize) {
+        commandPromptSize = lineLength + 1;
+        commandPrompt = (char*) realloc(commandPrompt, commandPromptSize);
     }
+    memcpy(commandPrompt, line, lineLength);
+    commandPrompt[lineLength] = '\0';
+    return 0;
+}
 
-    //printf("command prompt is now: '%s'\n", commandPrompt);
-
-    //if not enabled, then after updating the arg string, revert background flag
-    if(!isBackgroundEnabled)
-        isBackgroundTask = 0;
-
-    //replacing $$ if it happens not to be spaced apart from other things
-    endP = strstr(commandPrompt, "$$");
-    if (endP != NULL) {
-        //get pid
-        memset(shellPid, '\0', 10);
-        snprintf(shellPid, 10, "%d", (int) getpid());
-        int pidLength = (int) strlen(shellPid);
-
-        int indexInsertion = endP - commandPrompt;
+//maps a script file into memory for script mode; falls back to reading it in large chunks if it can't be mapped
+void LoadScript(char *fileName) {
+    int fileDescriptor = open(fileName, O_RDONLY | O_CLOEXEC);
+    if (fileDescriptor == -1) {
+        fprintf(stderr, "smallsh: cannot open script '%s'\n", fileName);
+        exit(127);
+    }
 
-        //move enough space for pid insertion
-        for (int i = strlen(commandPrompt) + pidLength; i > indexInsertion + pidLength; i--) {
-            commandPrompt[i] = commandPrompt[i-pidLength];
+    struct stat fileInfo;
+    if (fstat(fileDescriptor, &fileInfo) == 0 && S_ISREG(fileInfo.st_mode)) {
+        scriptLength = fileInfo.st_size;
+        if (scriptLength == 0) {
+            close(fileDescriptor);
+            return;
+        }
+        scriptText = (char*) mmap(NULL, scriptLength, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+        if (scriptText != MAP_FAILED) {
+            madvise(scriptText, scriptLength, MADV_SEQUENTIAL);
+            close(fileDescriptor);
+            return;
         }
-
-        //insert pid
-        for (int i = 0; i < pidLength; i++)
-            commandPrompt[i+indexInsertion] = shellPid[i];
     }
 
-//    printf("length: %d. content: '%s'\n", strlen(commandPrompt), commandPrompt);
+    size_t capacity = SCRIPT_READ_CHUNK;
+    ssize_t count;
+    scriptText = (char*) malloc(capacity);
+    scriptLength = 0;
+    while ((count = read(fileDescriptor, scriptText + scriptLength, capacity - scriptLength)) != 0) {
+        if (count == -1) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "smallsh: cannot read script '%s'\n", fileName);
+            exit(127);
+        }
+        scriptLength += count;
+        if (scriptLength == capacity) {
+            capacity *= 2;
+            scriptText = (char*) realloc(scriptText, capacity);
+        }
+    }
+    close(fileDescriptor);
 }
 
-//parses command prompt input into array of strings with space as delimiter
+//splits the command line into words, pipeline stages and redirections in one pass over it, into arrays that are
+//reused from line to line. 'single quotes' keep everything, "double quotes" keep everything except $$ and
+//\" \\ \$, and a backslash outside quotes escapes the next character. $$ anywhere outside single quotes expands
+//to the shell's pid. unquoted |, <, >, >>, 2>, 2>>, 2>&1, &> and <<< are operators even without spaces around
+//them, and a final & makes the line a background task. a line starting with # is a comment
 void ParseCommandPrompt() {
-    char *token;
     argsCount = 0;
-    commandArgs = (char**) malloc(MAX_ARGS * sizeof(char *)); //allocates maximum arguments; remember to free!
+    stageCount = 1;
+    redirectionsCount = 0;
+    isBackgroundTask = 0;
+    isTimedTask = 0;
 
-    //blank line; set first element as __blank to indicate so
-    if (strlen(commandPrompt) <= 1) {
+    //words never take more room than the line itself, except that each $$ (2 characters) becomes the pid
+    size_t lineLength = strlen(commandPrompt);
+    size_t arenaNeeded = lineLength + (lineLength / 2) * shellPidLength + 1;
+    if (arenaNeeded > wordArenaSize) {
+        wordArenaSize = arenaNeeded;
+        wordArena = (char*) realloc(wordArena, wordArenaSize);
+        patternBuffer = (char*) realloc(patternBuffer, 2 * wordArenaSize); //every character may get a '\\'
+    }
+    globCurrent = globBlocks;
+    for (struct GlobBlock *block = globBlocks; block != NULL; block = block->next)
+        block->used = 0;
+
+    commandArgs = (char**) GrowArray(commandArgs, &commandArgsSize, 1, sizeof(char*));
+    stages = (struct Stage*) GrowArray(stages, &stagesSize, 1, sizeof(struct Stage));
+    memset(&stages[0], 0, sizeof(struct Stage));
+
+    char *in = commandPrompt;
+    char *out = wordArena;
+    int pendingRedirect = -1;           //type of a redirection waiting for its file name, -1 if none
+    int pendingTarget = 0;              //stream it replaces
+    int isPendingBoth = 0;              //"&>": stderr follows stdout into the file
+    char pendingOperator[4];            //for the error message if the file name never comes
+    char errorMessage[64];
+
+    while (*in == ' ' || *in == '\t')
+        in++;
+    if (*in == '#') {
         commandArgs[0] = blank;
+        return;
     }
-    else {
-        //stores each argument in order to string array
-        token = strtok(commandPrompt, " ");
-        while (token != NULL && argsCount < MAX_ARGS) {
-            //if it's $$, expand into PID instead
-            if (strcmp(token, "$$") == 0) {
-                memset(shellPid, '\0', 10);
-                snprintf(shellPid, 10, "%d", (int) getpid());
-                commandArgs[argsCount] = shellPid;
+
+    while (1) {
+        while (*in == ' ' || *in == '\t')
+            in++;
+        if (*in == '\0')
+            break;
+
+        //operators. the longest match wins, and "2>" only counts at the start of a word
+        int operatorLength = 0, operatorType = -1, operatorTarget = 0;
+        if (strncmp(in, "2>&1", 4) == 0)
+            operatorLength = 4, operatorType = REDIRECT_DUP, operatorTarget = 2;
+        else if (strncmp(in, "<<<", 3) == 0)
+            operatorLength = 3, operatorType = REDIRECT_HERE, operatorTarget = 0;
+        else if (strncmp(in, "2>>", 3) == 0)
+            operatorLength = 3, operatorType = REDIRECT_APPEND, operatorTarget = 2;
+        else if (strncmp(in, "2>", 2) == 0)
+            operatorLength = 2, operatorType = REDIRECT_WRITE, operatorTarget = 2;
+        else if (strncmp(in, ">>", 2) == 0)
+            operatorLength = 2, operatorType = REDIRECT_APPEND, operatorTarget = 1;
+        else if (strncmp(in, "&>", 2) == 0)
+            operatorLength = 2, operatorType = REDIRECT_WRITE, operatorTarget = 1;
+        else if (*in == '>')
+            operatorLength = 1, operatorType = REDIRECT_WRITE, operatorTarget = 1;
+        else if (*in == '<')
+            operatorLength = 1, operatorType = REDIRECT_READ, operatorTarget = 0;
+        else if (*in == '|')
+            operatorLength = 1;
+
+        if (operatorLength > 0) {
+            if (pendingRedirect != -1) {
+                snprintf(errorMessage, sizeof(errorMessage), "missing file name after '%s'", pendingOperator);
+                ParseError(errorMessage);
+                return;
             }
-            else
-                commandArgs[argsCount] = token;
-            argsCount++;
+            if (operatorType == REDIRECT_DUP)
+                AddRedirection(operatorTarget, REDIRECT_DUP, NULL);
+            else if (operatorType != -1) {
+                pendingRedirect = operatorType;
+                pendingTarget = operatorTarget;
+                isPendingBoth = (*in == '&');
+                memcpy(pendingOperator, in, operatorLength);
+                pendingOperator[operatorLength] = '\0';
+            }
+            else {
+                //end the current stage's argv with NULL and start the next one after it
+                commandArgs = (char**) GrowArray(commandArgs, &commandArgsSize, argsCount + 2, sizeof(char*));
+                commandArgs[argsCount++] = NULL;
+                stages = (struct Stage*) GrowArray(stages, &stagesSize, stageCount + 1, sizeof(struct Stage));
+                memset(&stages[stageCount], 0, sizeof(struct Stage));
+                stages[stageCount].argStart = argsCount;
+                stages[stageCount].redirectStart = redirectionsCount;
+                stageCount++;
+            }
+            in += operatorLength;
+            continue;
+        }
+        if (*in == '&' && in[1 + strspn(in + 1, " \t")] == '\0') {
+            isBackgroundTask = isBackgroundEnabled;
+            break;
+        }
+
+        //one word, copied into the arena without its quotes and escapes. it is also copied as a glob pattern,
+        //where quoted wildcards are escaped, in case it has unquoted ones
+        char *word = out;
+        char *pattern = patternBuffer;
+        char *bracket = NULL; //first unquoted '[' in pattern
+        int quote = 0, isWildcard = 0;
+        for (; *in != '\0'; in++) {
+            char c;
+            int isQuoted = 1;
+            if (quote == '\'') {
+                if (*in == '\'') {
+                    quote = 0;
+                    continue;
+                }
+                c = *in;
+            }
+            else if (in[0] == '$' && in[1] == '$') {
+                memcpy(out, shellPid, shellPidLength);
+                out += shellPidLength;
+                memcpy(pattern, shellPid, shellPidLength);
+                pattern += shellPidLength;
+                in++;
+                continue;
+            }
+            else if (quote == '"') {
+                if (*in == '"') {
+                    quote = 0;
+                    continue;
+                }
+                else if (in[0] == '\\' && in[1] != '\0' && strchr("\"\\$", in[1]) != NULL)
+                    c = *++in;
+                else
+                    c = *in;
+            }
+            else if (*in == ' ' || *in == '\t' || *in == '|' || *in == '<' || *in == '>' || (in[0] == '&' && in[1] == '>'))
+                break;
+            else if (*in == '\'' || *in == '"') {
+                quote = *in;
+                continue;
+            }
+            else if (*in == '\\' && in[1] != '\0')
+                c = *++in;
+            else {
+                c = *in;
+                isQuoted = 0;
+            }
+
+            *out++ = c;
+            if (isQuoted && strchr("*?[]\\", c) != NULL)
+                *pattern++ = '\\';
+            else if (!isQuoted && (c == '*' || c == '?'))
+                isWildcard = 1;
+            else if (!isQuoted && c == '[' && bracket == NULL)
+                bracket = pattern;
+            *pattern++ = c;
+        }
+        if (quote != 0) {
+            ParseError(quote == '\'' ? "missing closing '" : "missing closing \"");
+            return;
+        }
+        *out++ = '\0';
+        *pattern = '\0';
+        if (bracket != NULL && strchr(bracket, ']') != NULL)
+            isWildcard = 1; //a lone '[' (like the test command) is just a word
+
+        if (pendingRedirect != -1) {
+            AddRedirection(pendingTarget, pendingRedirect, word);
+            if (isPendingBoth)
+                AddRedirection(2, REDIRECT_DUP, NULL);
+            pendingRedirect = -1;
+        }
+        //words with wildcards become the sorted list of matching paths, or stay as they are if nothing matches
+        else if (!isWildcard || ExpandGlob(patternBuffer) == 0) {
+            commandArgs = (char**) GrowArray(commandArgs, &commandArgsSize, argsCount + 2, sizeof(char*));
+            commandArgs[argsCount++] = word;
+            stages[stageCount - 1].argsCount++;
+        }
+    }
+    commandArgs = (char**) GrowArray(commandArgs, &commandArgsSize, argsCount + 1, sizeof(char*));
+    commandArgs[argsCount] = NULL;
+
+    if (pendingRedirect != -1) {
+        snprintf(errorMessage, sizeof(errorMessage), "missing file name after '%s'", pendingOperator);
+        ParseError(errorMessage);
+        return;
+    }
+
+    //blank line; set first element as __blank to indicate so
+    if (argsCount == 0 && stageCount == 1 && redirectionsCount == 0) {
+        commandArgs[0] = blank;
+        return;
+    }
+
+    //"time cmd ...": drop the prefix and remember to report the resources cmd used
+    if (stages[0].argsCount > 1 && strcmp(commandArgs[0], "time") == 0) {
+        isTimedTask = 1;
+        argsCount--;
+        stages[0].argsCount--;
+        memmove(commandArgs, commandArgs + 1, (argsCount + 1) * sizeof(char*));
+        for (int i = 1; i < stageCount; i++)
+            stages[i].argStart--;
+    }
+
+    //reject stages with nothing to run, like "| a", "a | | b", "a |" or "< file"
+    for (int i = 0; i < stageCount; i++) {
+        if (stages[i].argsCount == 0) {
+            ParseError(stages[i].redirectCount > 0 ? "nothing to run besides redirection" : "missing command around '|'");
+            return;
+        }
+    }
+}
+
+//adds every path matching a glob pattern to the last stage of the line being parsed, sorted like "ls" would
+//(byte order). *, ? and [...] work in every part of the path but don't match a leading '.' or a '/'.
+//returns the number of paths added
+int ExpandGlob(char *pattern) {
+    char path[PATH_MAX];
+    int before = argsCount;
+
+    if (pattern[0] == '/') {
+        path[0] = '/';
+        while (*pattern == '/')
+            pattern++;
+        GlobDirectory(path, 1, pattern);
+    }
+    else
+        GlobDirectory(path, 0, pattern);
+    return argsCount - before;
+}
+
+//matches the first part of pattern (up to a '/') against the directory path[0..pathLength) and goes on with the
+//rest of the pattern in every matching subdirectory
+void GlobDirectory(char *path, size_t pathLength, char *pattern) {
+    char component[PATH_MAX];
+    char *rest = strchr(pattern, '/');
+    size_t componentLength = (rest != NULL) ? (size_t) (rest - pattern) : strlen(pattern);
+    if (componentLength >= sizeof(component))
+        return;
+    memcpy(component, pattern, componentLength);
+    component[componentLength] = '\0';
+    int isDirectoryOnly = 0; //"dir*/" matches just the directories, with their '/'
+    if (rest != NULL) {
+        while (*rest == '/')
+            rest++;
+        if (*rest == '\0') {
+            rest = NULL;
+            isDirectoryOnly = 1;
+        }
+    }
+
+    //no wildcards in this part: no need to list the directory, just take the name as it is
+    int isLiteral = (strpbrk(component, "*?[") == NULL);
+    if (isLiteral) {
+        size_t length = 0;
+        for (char *c = component; *c != '\0'; c++) {
+            if (*c == '\\' && c[1] != '\0')
+                c++;
+            component[length++] = *c;
+        }
+        component[length] = '\0';
+    }
+
+    struct DirectoryListing *listing = NULL;
+    if (!isLiteral) {
+        path[pathLength] = '\0';
+        listing = ReadDirectory(pathLength > 0 ? path : ".");
+        if (listing == NULL)
+            return;
+    }
+
+    int count = isLiteral ? 1 : listing->count;
+    for (int i = 0; i < count; i++) {
+        char *name = isLiteral ? component : listing->entries[i].name;
+        if (!isLiteral && fnmatch(component, name, FNM_PERIOD) != 0)
+            continue;
+
+        size_t nameLength = strlen(name);
+        if (pathLength + nameLength + 2 > PATH_MAX)
+            continue;
+        memcpy(path + pathLength, name, nameLength + 1);
+
+        //the last part: a listed name exists; a literal one has to be checked
+        struct stat fileInfo;
+        if (rest == NULL && !isDirectoryOnly) {
+            if (!isLiteral || lstat(path, &fileInfo) == 0)
+                AddGlobMatch(path);
+            continue;
+        }
+
+        //only directories can have more parts matched inside them
+        unsigned char type = isLiteral ? DT_UNKNOWN : listing->entries[i].type;
+        int isDirectory = (type == DT_DIR);
+        if (type == DT_UNKNOWN || type == DT_LNK)
+            isDirectory = (stat(path, &fileInfo) == 0 && S_ISDIR(fileInfo.st_mode));
+        if (!isDirectory)
+            continue;
+        path[pathLength + nameLength] = '/';
+        path[pathLength + nameLength + 1] = '\0';
+        if (rest == NULL)
+            AddGlobMatch(path);
+        else
+            GlobDirectory(path, pathLength + nameLength + 1, rest);
+    }
+}
+
+//copies a matched path into the line's glob storage and adds it as a word of the last stage
+void AddGlobMatch(char *path) {
+    size_t length = strlen(path) + 1;
+    while (globCurrent == NULL || globCurrent->used + length > globCurrent->size) {
+        if (globCurrent != NULL && globCurrent->next != NULL) {
+            globCurrent = globCurrent->next;
+            continue;
+        }
+        size_t size = (length > GLOB_BLOCK_SIZE) ? length : GLOB_BLOCK_SIZE;
+        struct GlobBlock *block = (struct GlobBlock*) malloc(sizeof(struct GlobBlock) + size);
+        block->next = NULL;
+        block->size = size;
+        block->used = 0;
+        if (globCurrent == NULL)
+            globBlocks = block;
+        else
+            globCurrent->next = block;
+        globCurrent = block;
+    }
+
+    char *match = globCurrent->data + globCurrent->used;
+    memcpy(match, path, length);
+    globCurrent->used += length;
+
+    commandArgs = (char**) GrowArray(commandArgs, &commandArgsSize, argsCount + 2, sizeof(char*));
+    commandArgs[argsCount++] = match;
+    stages[stageCount - 1].argsCount++;
+}
+
+//returns the sorted listing of a directory, from the cache if the directory hasn't changed since it was read.
+//NULL if it can't be read
+struct DirectoryListing* ReadDirectory(char *directoryPath) {
+    struct stat directoryInfo;
+    if (stat(directoryPath, &directoryInfo) != 0 || !S_ISDIR(directoryInfo.st_mode))
+        return NULL;
+
+    if (dirCache == NULL) {
+        dirCacheSize = DIR_CACHE_MIN_SIZE;
+        dirCache = (struct DirectoryListing*) calloc(dirCacheSize, sizeof(struct DirectoryListing));
+    }
+    struct DirectoryListing *listing = DirCacheSlot(directoryPath);
+    if (listing->path != NULL && listing->device == directoryInfo.st_dev && listing->inode == directoryInfo.st_ino &&
+        listing->modified.tv_sec == directoryInfo.st_mtim.tv_sec &&
+        listing->modified.tv_nsec == directoryInfo.st_mtim.tv_nsec)
+        return listing;
 
-            if (argsCount == MAX_ARGS)
-                printf("Warning, # of arguments is at max arguments allowed. Additional arguments ignored.");
+    DIR *directory = opendir(directoryPath);
+    if (directory == NULL)
+        return NULL;
 
-            token = strtok(NULL, " ");
+    //new path: grow before the table gets too full to probe quickly, then claim a slot
+    if (listing->path == NULL) {
+        if ((dirCacheCount + 1) * 4 > dirCacheSize * 3) {
+            struct DirectoryListing *oldCache = dirCache;
+            int oldSize = dirCacheSize;
+            dirCacheSize = oldSize * 2;
+            dirCache = (struct DirectoryListing*) calloc(dirCacheSize, sizeof(struct DirectoryListing));
+            for (int i = 0; i < oldSize; i++) {
+                if (oldCache[i].path != NULL)
+                    *DirCacheSlot(oldCache[i].path) = oldCache[i];
+            }
+            free(oldCache);
+            listing = DirCacheSlot(directoryPath);
+        }
+        listing->path = strdup(directoryPath);
+        dirCacheCount++;
+    }
+
+    //names go into one blob; entries keep offsets into it until it stops moving
+    size_t blobSize = 4096, blobUsed = 0;
+    int capacity = 64;
+    char *blob = (char*) malloc(blobSize);
+    struct DirectoryEntry *entries = (struct DirectoryEntry*) malloc(capacity * sizeof(struct DirectoryEntry));
+    int count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(directory)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        size_t length = strlen(entry->d_name) + 1;
+        while (blobUsed + length > blobSize) {
+            blobSize *= 2;
+            blob = (char*) realloc(blob, blobSize);
+        }
+        if (count == capacity) {
+            capacity *= 2;
+            entries = (struct DirectoryEntry*) realloc(entries, capacity * sizeof(struct DirectoryEntry));
         }
+        memcpy(blob + blobUsed, entry->d_name, length);
+        entries[count].name = (char*) blobUsed;
+        entries[count].type = entry->d_type;
+        blobUsed += length;
+        count++;
     }
+    closedir(directory);
+
+    for (int i = 0; i < count; i++)
+        entries[i].name = blob + (size_t) entries[i].name;
+    qsort(entries, count, sizeof(struct DirectoryEntry), CompareEntries);
+
+    free(listing->entries);
+    free(listing->nameBlob);
+    listing->device = directoryInfo.st_dev;
+    listing->inode = directoryInfo.st_ino;
+    listing->modified = directoryInfo.st_mtim;
+    listing->entries = entries;
+    listing->count = count;
+    listing->nameBlob = blob;
+    return listing;
+}
+
+//slot for a directory path in the listing cache: the one holding it, or the empty one where it would go
+struct DirectoryListing* DirCacheSlot(char *directoryPath) {
+    unsigned int hash = 2166136261u;
+    for (char *c = directoryPath; *c != '\0'; c++)
+        hash = (hash ^ (unsigned char) *c) * 16777619u;
+
+    unsigned int slot = hash & (dirCacheSize - 1);
+    while (dirCache[slot].path != NULL && strcmp(dirCache[slot].path, directoryPath) != 0)
+        slot = (slot + 1) & (dirCacheSize - 1);
+    return &dirCache[slot];
+}
+
+int CompareEntries(const void *a, const void *b) {
+    return strcmp(((const struct DirectoryEntry*) a)->name, ((const struct DirectoryEntry*) b)->name);
+}
+
+//records a redirection of the last stage of the line being parsed
+void AddRedirection(int targetFD, int type, char *fileName) {
+    redirections = (struct Redirection*) GrowArray(redirections, &redirectionsSize, redirectionsCount + 1,
+                                                   sizeof(struct Redirection));
+    redirections[redirectionsCount].targetFD = targetFD;
+    redirections[redirectionsCount].type = type;
+    redirections[redirectionsCount].fileName = fileName;
+    redirectionsCount++;
+    stages[stageCount - 1].redirectCount++;
+}
+
+//reports a line that can't be run; it is then treated as a blank line
+void ParseError(char *message) {
+    fprintf(stderr, "command failed: %s\n", message);
+    argsCount = 0;
+    stageCount = 1;
+    isBackgroundTask = 0;
+    isTimedTask = 0;
+    commandArgs[0] = blank;
+}
+
+//makes sure array has room for needed elements, doubling its size (starting at PARSE_MIN_SIZE) as required
+void* GrowArray(void *array, int *size, int needed, size_t elementSize) {
+    if (needed <= *size)
+        return array;
+    int newSize = (*size > 0) ? *size : PARSE_MIN_SIZE;
+    while (newSize < needed)
+        newSize *= 2;
+    *size = newSize;
+    return realloc(array, newSize * elementSize);
 }
 
 //built-in command 'exit' - kills all active child processes then exits shell
 void CommandExit() {
-    for (int i = 0; i < BG_PID_SIZE; i++) {
-        if (bgPid[i] > 0)
-            kill(bgPid[i], SIGTERM);
+    for (int i = 0; i < jobTableSize; i++) {
+        if (jobTable[i].pid > 0)
+            kill(jobTable[i].pid, SIGTERM);
     }
 }
 
@@ -153,7 +815,8 @@ void CommandCd() {
     }
 }
 
-//built-in command 'status' - displays the exit status or terminating signal of last FG process
+//built-in command 'status' - displays the exit status or terminating signal of last FG process.
+//'status -v' also shows the resources that process used
 void CommandStatus() {
     if (!isTermBySignal) {
         printf("process finished with exit status: %d\n", exitStatus);
@@ -163,10 +826,144 @@ void CommandStatus() {
         printf("process terminated by signal: %d\n", exitStatus);
         fflush(stdout);
     }
+
+    if (argsCount > 1 && strcmp(commandArgs[1], "-v") == 0)
+        PrintUsage(&lastUsage);
+}
+
+//built-in command 'hash' - no argument lists the remembered command paths, '-r' forgets them all,
+//otherwise searches PATH again for the given commands and remembers them
+void CommandHash() {
+    if (argsCount == 1) {
+        int isEmpty = 1;
+        for (int i = 0; i < pathCacheSize; i++) {
+            if (pathCache[i].path != NULL) {
+                if (isEmpty)
+                    printf("hits\tcommand\n");
+                isEmpty = 0;
+                printf("%4d\t%s\n", pathCache[i].hits, pathCache[i].path);
+            }
+        }
+        if (isEmpty)
+            printf("hash: hash table empty\n");
+        fflush(stdout);
+    }
+    else if (strcmp(commandArgs[1], "-r") == 0)
+        PathCacheClear();
+    else {
+        for (int i = 1; i < argsCount; i++) {
+            ForgetCommandPath(commandArgs[i]);
+            if (LookupCommandPath(commandArgs[i]) == NULL)
+                fprintf(stderr, "hash: %s: not found\n", commandArgs[i]);
+        }
+    }
+}
+
+//forgets every remembered command path; also used when PATH changes
+void PathCacheClear() {
+    for (int i = 0; i < pathCacheSize; i++) {
+        free(pathCache[i].name);
+        free(pathCache[i].path);
+    }
+    free(pathCache);
+    pathCacheSize = PATH_CACHE_MIN_SIZE;
+    pathCache = (struct CommandPath*) calloc(pathCacheSize, sizeof(struct CommandPath));
+    pathCacheCount = 0;
+}
+
+//returns the slot holding name, or the empty slot where it would go (linear probing on an FNV-1a hash)
+struct CommandPath* PathCacheSlot(char *name) {
+    unsigned int hash = 2166136261u;
+    for (char *c = name; *c != '\0'; c++)
+        hash = (hash ^ (unsigned char) *c) * 16777619u;
+
+    unsigned int slot = hash & (pathCacheSize - 1);
+    while (pathCache[slot].name != NULL && strcmp(pathCache[slot].name, name) != 0)
+        slot = (slot + 1) & (pathCacheSize - 1);
+    return &pathCache[slot];
+}
+
+//drops the remembered path of one command, so the next use searches PATH again. the name stays in its slot
+//(with a NULL path) to keep the probe sequence of other names intact
+void ForgetCommandPath(char *name) {
+    struct CommandPath *entry = PathCacheSlot(name);
+    free(entry->path);
+    entry->path = NULL;
+    entry->hits = 0;
+}
+
+//returns the absolute path execvp() would run for a command name, searching PATH only on the first use.
+//names with a '/' are returned as-is. NULL if the command can't be found
+char* LookupCommandPath(char *name) {
+    if (strchr(name, '/') != NULL)
+        return name;
+
+    //PATH changed since the cache was filled: everything in it may be wrong now
+    char *searchPath = getenv("PATH");
+    if (searchPath == NULL)
+        searchPath = "/bin:/usr/bin";
+    if (pathCacheFor == NULL || strcmp(pathCacheFor, searchPath) != 0) {
+        PathCacheClear();
+        free(pathCacheFor);
+        pathCacheFor = strdup(searchPath);
+    }
+
+    struct CommandPath *entry = PathCacheSlot(name);
+    if (entry->path != NULL)
+        return entry->path;
+
+    //not remembered: take the first executable regular file along PATH
+    size_t nameLength = strlen(name);
+    char *directory = searchPath;
+    char *candidate = NULL;
+    while (candidate == NULL) {
+        char *end = strchrnul(directory, ':');
+        size_t directoryLength = end - directory;
+        candidate = (char*) malloc(directoryLength + nameLength + 3);
+        if (directoryLength == 0) //empty PATH element means current directory
+            strcpy(candidate, ".");
+        else {
+            memcpy(candidate, directory, directoryLength);
+            candidate[directoryLength] = '\0';
+        }
+        strcat(candidate, "/");
+        strcat(candidate, name);
+
+        struct stat fileInfo;
+        if (stat(candidate, &fileInfo) != 0 || !S_ISREG(fileInfo.st_mode) || access(candidate, X_OK) != 0) {
+            free(candidate);
+            candidate = NULL;
+            if (*end == '\0')
+                return NULL;
+            directory = end + 1;
+        }
+    }
+
+    //new name: grow before the table gets too full to probe quickly, then claim a slot
+    if (entry->name == NULL) {
+        if ((pathCacheCount + 1) * 4 > pathCacheSize * 3) {
+            struct CommandPath *oldCache = pathCache;
+            int oldSize = pathCacheSize;
+            pathCacheSize = oldSize * 2;
+            pathCache = (struct CommandPath*) calloc(pathCacheSize, sizeof(struct CommandPath));
+            for (int i = 0; i < oldSize; i++) {
+                if (oldCache[i].name != NULL)
+                    *PathCacheSlot(oldCache[i].name) = oldCache[i];
+            }
+            free(oldCache);
+            entry = PathCacheSlot(name);
+        }
+        entry->name = strdup(name);
+        pathCacheCount++;
+    }
+    entry->path = candidate;
+    entry->hits = 0;
+    return candidate;
 }
 
-//function to regulate execution of non-built in commands with exec()
-void ChildExecute(pid_t spawnpid) {
+//function to regulate execution of non-built in commands with exec() in a forked child.
+//only used when posix_spawn can't do the job; redirections were already opened by the shell
+void ChildExecute(char **args, char *path, int *stdFDs) {
     //all children processes ignore SIGTSTP signal
     struct sigaction SIGTSTP_action = {0};
     SIGTSTP_action.sa_handler = SIG_IGN;
@@ -179,105 +976,826 @@ void ChildExecute(pid_t spawnpid) {
         sigaction(SIGINT, &SIGINT_action, NULL);
     }
 
-    //process any redirection and modify commandArgs to remove shell operators
-    ManageRedirection();
+    //shell blocks SIGCHLD for its signalfd; give the child the normal signal mask back
+    sigprocmask(SIG_SETMASK, &childSignalMask, NULL);
+
+    //hook up pipes and redirections; shell's copies are close-on-exec, the dup2'd ones are not
+    for (int i = 0; i < 3; i++) {
+        if (stdFDs[i] != -1 && dup2(stdFDs[i], i) == -1) {
+            fprintf(stderr, "command failed: redirection of fd %d failed.\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
 
-    execvp(commandArgs[0], commandArgs); //execute the command!!
+    execvp(path, args); //execute the command!! a path with '/' still gets the /bin/sh fallback for scripts
 
     //catch for if exec() fails due to invalid command
-    fprintf(stderr, "command failed: command '%s' is invalid\n", commandArgs[0]);
+    fprintf(stderr, "command failed: command '%s' is invalid\n", args[0]);
     exit(EXIT_FAILURE);
 }
 
-//constructs an improved command argument array that processes redirection (<, >)
-void ManageRedirection() {
-    int fileDescriptor; //file descriptors
+//built-in command 'parallel' - "parallel [-j N] [-g] command args... [::: inputs...]" runs the command once
+//per input with {} in the args replaced by it (or the input added as the last arg if there is no {}).
+//inputs are the words after ":::", otherwise the lines of stdin. exactly N jobs (default: one per CPU) run
+//at a time; the next one starts as soon as SIGCHLD reports one done. -g holds each job's output back and
+//prints it in one piece when the job finishes. redirections of the line apply to the shell for the whole run, so
+//the jobs (and the inputs read from stdin) use them. a job killed by SIGINT stops the jobs not started yet.
+//status is the number of failed jobs, not started ones included
+void CommandParallel() {
+    int maxJobs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    int isGrouped = 0;
+    int i = 1;
 
-    //iterate through the original command arguments, look for redirection to process
-    for (int i = 0; i < argsCount; i++) {
-        //if it's a background task, by default set i/o to /dev/null
-        if (isBackgroundTask == 1) {
-            //stdin
-            fileDescriptor = open("/dev/null", O_RDONLY);
-            if (fileDescriptor == -1) {
-                fprintf(stderr, "command failed: cannot open stdin '/dev/null' for background task.");
-                exit(EXIT_FAILURE);
+    //options
+    for (; i < argsCount && commandArgs[i][0] == '-'; i++) {
+        if (strcmp(commandArgs[i], "-g") == 0)
+            isGrouped = 1;
+        else if (strcmp(commandArgs[i], "-j") == 0) {
+            if (i + 1 == argsCount || atoi(commandArgs[i+1]) < 1) {
+                fprintf(stderr, "parallel: -j needs a number of jobs of at least 1\n");
+                exitStatus = EXIT_FAILURE;
+                isTermBySignal = 0;
+                return;
             }
-            //redirect and verify success
-            if (dup2(fileDescriptor, 0) == -1) {
-                fprintf(stderr, "command failed: cannot set '/dev/null' as stdin for background task.");
-                exit(EXIT_FAILURE);
+            maxJobs = atoi(commandArgs[++i]);
+        }
+        else
+            break;
+    }
+    if (maxJobs < 1)
+        maxJobs = 1;
+
+    //command template runs up to ":::"
+    char **template = &commandArgs[i];
+    int templateCount = 0;
+    while (i < argsCount && strcmp(commandArgs[i], ":::") != 0) {
+        i++;
+        templateCount++;
+    }
+    if (templateCount == 0) {
+        fprintf(stderr, "parallel: usage: parallel [-j N] [-g] command [args with {}] [::: inputs...]\n");
+        exitStatus = EXIT_FAILURE;
+        isTermBySignal = 0;
+        return;
+    }
+
+    int savedFDs[3];
+    if (RedirectShell(savedFDs) == -1) {
+        exitStatus = EXIT_FAILURE;
+        isTermBySignal = 0;
+        return;
+    }
+
+    //inputs: words after ":::", or every line of stdin. jobs get /dev/null as stdin in the latter case
+    char **inputs;
+    int inputCount = 0;
+    int isStdinInput = (i == argsCount);
+    char *line = NULL;
+    if (!isStdinInput) {
+        inputs = &commandArgs[i + 1];
+        inputCount = argsCount - i - 1;
+    }
+    else {
+        int inputCapacity = 64;
+        size_t lineCapacity = 0;
+        ssize_t lineLength;
+        inputs = (char**) malloc(inputCapacity * sizeof(char*));
+        while ((lineLength = getline(&line, &lineCapacity, stdin)) != -1) {
+            if (lineLength > 0 && line[lineLength - 1] == '\n')
+                line[lineLength - 1] = '\0';
+            if (inputCount == inputCapacity) {
+                inputCapacity *= 2;
+                inputs = (char**) realloc(inputs, inputCapacity * sizeof(char*));
             }
+            inputs[inputCount++] = strdup(line);
+        }
+        clearerr(stdin); //ctrl+d at a terminal only ends the input list, not the shell
+    }
+
+    int nullFD = -1;
+    if (isStdinInput)
+        nullFD = open("/dev/null", O_RDONLY | O_CLOEXEC);
 
-            //stdout
-            fileDescriptor = open("/dev/null", O_WRONLY | O_CREAT | O_TRUNC, 0644);
-            if (fileDescriptor == -1) {
-                fprintf(stderr, "command failed: cannot open stdout '/dev/null' for background task.");
-                exit(EXIT_FAILURE);
+    //same signal setup as ExecutePipeline(), held for the whole run: children start out ignoring SIGTSTP
+    sigset_t stopSignal;
+    sigemptyset(&stopSignal);
+    sigaddset(&stopSignal, SIGTSTP);
+    sigprocmask(SIG_BLOCK, &stopSignal, NULL);
+    struct sigaction SIGTSTP_ignore = {0}, SIGTSTP_shell;
+    SIGTSTP_ignore.sa_handler = SIG_IGN;
+    sigaction(SIGTSTP, &SIGTSTP_ignore, &SIGTSTP_shell);
+    int wasBackgroundTask = isBackgroundTask;
+    isBackgroundTask = 0; //jobs run in the foreground even if the line ended in '&'
+
+    //running jobs: pid (0 for a free slot) and, with -g, the memfd holding its output
+    pid_t *slotPids = (pid_t*) calloc(maxJobs, sizeof(pid_t));
+    int *slotOutputs = (int*) malloc(maxJobs * sizeof(int));
+    int running = 0, next = 0, failed = 0, isInterrupted = 0;
+    struct timespec startTime;
+    clock_gettime(CLOCK_MONOTONIC, &startTime);
+    fflush(stdout);
+
+    while ((next < inputCount && !isInterrupted) || running > 0) {
+        //fill every free slot
+        for (int slot = 0; slot < maxJobs && next < inputCount && !isInterrupted; slot++) {
+            if (slotPids[slot] != 0)
+                continue;
+            char **jobArgs = ParallelJobArgs(template, templateCount, inputs[next++]);
+            slotOutputs[slot] = isGrouped ? memfd_create("parallel", MFD_CLOEXEC) : -1;
+            int jobFDs[3] = {nullFD, slotOutputs[slot], -1};
+            slotPids[slot] = LaunchCommand(jobArgs, jobFDs);
+            for (int j = 0; jobArgs[j] != NULL; j++)
+                free(jobArgs[j]);
+            free(jobArgs);
+
+            if (slotPids[slot] == -1) {
+                ParallelFinish(-1, 0, slotOutputs[slot], &failed);
+                slotPids[slot] = 0;
             }
-            //redirect and verify success
-            if (dup2(fileDescriptor, 1) == -1) {
-                fprintf(stderr, "command failed: cannot set '/dev/null' as stdout for background task.");
-                exit(EXIT_FAILURE);
+            else
+                running++;
+        }
+        if (running == 0)
+            continue;
+
+        //sleep until a child exits. exits of background jobs are left for CheckBGProcesses() to report
+        struct pollfd waitFD = {sigchldFD, POLLIN, 0};
+        struct signalfd_siginfo info;
+        if (poll(&waitFD, 1, -1) == -1 && errno != EINTR)
+            break;
+        while (read(sigchldFD, &info, sizeof(info)) == sizeof(info))
+            isChildExitPending = 1;
+
+        int childExitMethod;
+        for (int slot = 0; slot < maxJobs; slot++) {
+            if (slotPids[slot] > 0 && waitpid(slotPids[slot], &childExitMethod, WNOHANG) > 0) {
+                if (WIFSIGNALED(childExitMethod) && WTERMSIG(childExitMethod) == SIGINT)
+                    isInterrupted = 1;
+                ParallelFinish(slotPids[slot], childExitMethod, slotOutputs[slot], &failed);
+                slotPids[slot] = 0;
+                running--;
             }
         }
+    }
 
-        //regular process redirection for "<" stdin and/or ">" stdout
-        if (strcmp(commandArgs[i], "<") == 0 || strcmp(commandArgs[i], ">") == 0) {
+    struct JobUsage elapsed;
+    SetWallTime(&elapsed, &startTime);
+    double seconds = elapsed.wallTime.tv_sec + elapsed.wallTime.tv_nsec / 1e9;
+    if (next < inputCount) {
+        fprintf(stderr, "parallel: interrupted, %d jobs not started\n", inputCount - next);
+        failed += inputCount - next;
+    }
+    fprintf(stderr, "parallel: %d jobs, %d failed, %.3fs, %.1f jobs/s\n", inputCount, failed, seconds,
+            seconds > 0 ? next / seconds : 0.0);
 
-            //check existence to avoid a segfault; for debugging only
-            if (commandArgs[i+1] == NULL)
-                printf("Warning bad command! Segfault will occur. Fix code.");
+    isBackgroundTask = wasBackgroundTask;
+    sigaction(SIGTSTP, &SIGTSTP_shell, NULL);
+    sigprocmask(SIG_UNBLOCK, &stopSignal, NULL);
 
-            //stdin
-            if (strcmp(commandArgs[i], "<") == 0) {
-                fileDescriptor = open(commandArgs[i+1], O_RDONLY);
-                if (fileDescriptor == -1) {
-                    fprintf(stderr, "command failed: cannot open '%s' as input\n", commandArgs[i+1]);
-                    exit(EXIT_FAILURE);
-                }
+    if (nullFD != -1)
+        close(nullFD);
+    if (isStdinInput) {
+        for (int j = 0; j < inputCount; j++)
+            free(inputs[j]);
+        free(inputs);
+        free(line);
+    }
+    free(slotPids);
+    free(slotOutputs);
+    RestoreShell(savedFDs);
+
+    exitStatus = failed < PARALLEL_MAX_STATUS ? failed : PARALLEL_MAX_STATUS;
+    isTermBySignal = 0;
+}
+
+//builds the argument list of one parallel job: the template with every {} replaced by the input,
+//or the input appended if the template has no {}. everything is malloc'd, NULL terminated
+char** ParallelJobArgs(char **template, int templateCount, char *input) {
+    char **jobArgs = (char**) malloc((templateCount + 2) * sizeof(char*));
+    int isSubstituted = 0;
+    size_t inputLength = strlen(input);
+
+    for (int i = 0; i < templateCount; i++) {
+        //count the {}s to size the result
+        int holes = 0;
+        for (char *hole = strstr(template[i], "{}"); hole != NULL; hole = strstr(hole + 2, "{}"))
+            holes++;
+
+        jobArgs[i] = (char*) malloc(strlen(template[i]) + holes * inputLength + 1);
+        char *out = jobArgs[i];
+        for (char *in = template[i]; *in != '\0'; ) {
+            if (in[0] == '{' && in[1] == '}') {
+                memcpy(out, input, inputLength);
+                out += inputLength;
+                in += 2;
+            }
+            else
+                *out++ = *in++;
+        }
+        *out = '\0';
+        isSubstituted |= (holes > 0);
+    }
+
+    int count = templateCount;
+    if (!isSubstituted)
+        jobArgs[count++] = strdup(input);
+    jobArgs[count] = NULL;
+    return jobArgs;
+}
+
+//bookkeeping for a finished parallel job (pid -1: it never started): counts failures,
+//reports signals, and with -g copies its held-back output to stdout
+void ParallelFinish(pid_t pid, int childExitMethod, int outputFD, int *failed) {
+    if (pid == -1 || !WIFEXITED(childExitMethod) || WEXITSTATUS(childExitMethod) != 0)
+        (*failed)++;
+    if (pid != -1 && WIFSIGNALED(childExitMethod))
+        fprintf(stderr, "parallel: pid %d terminated by signal: %d\n", (int) pid, WTERMSIG(childExitMethod));
+
+    if (outputFD == -1)
+        return;
+    char buffer[65536];
+    ssize_t count;
+    lseek(outputFD, 0, SEEK_SET);
+    while ((count = read(outputFD, buffer, sizeof(buffer))) > 0) {
+        ssize_t written = 0;
+        while (written < count) {
+            ssize_t n = write(STDOUT_FILENO, buffer + written, count - written);
+            if (n <= 0)
+                break;
+            written += n;
+        }
+        if (written < count)
+            break;
+    }
+    close(outputFD);
+}
+
+//returns the in-shell version of a utility command, or NULL if it has to be launched
+BuiltinFunction FindUtilityBuiltin(char *name) {
+    for (int i = 0; utilityBuiltins[i].name != NULL; i++) {
+        if (strcmp(utilityBuiltins[i].name, name) == 0)
+            return utilityBuiltins[i].run;
+    }
+    return NULL;
+}
+
+//runs a utility builtin without forking, with the line's redirections applied to the shell itself
+void RunUtilityBuiltin(BuiltinFunction run) {
+    int savedFDs[3];
+    if (RedirectShell(savedFDs) == -1) {
+        exitStatus = EXIT_FAILURE;
+        isTermBySignal = 0;
+        return;
+    }
+
+    exitStatus = run(stages[0].argsCount, commandArgs);
+    isTermBySignal = 0;
+    RestoreShell(savedFDs);
+}
+
+//applies the first stage's redirections by pointing the shell's own stdin/stdout/stderr at the files, saving
+//the descriptors they replace in savedFDs (-1 for the ones left alone) for RestoreShell(). returns -1 if a
+//file can't be opened (then nothing was changed)
+int RedirectShell(int *savedFDs) {
+    int stdFDs[3] = {-1, -1, -1};
+    int isOwned[3] = {0, 0, 0};
+
+    for (int i = 0; i < 3; i++)
+        savedFDs[i] = -1;
+    if (ManageRedirection(&stages[0], stdFDs, isOwned) == -1)
+        return -1;
+
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = 0; i < 3; i++) {
+        if (stdFDs[i] != -1) {
+            savedFDs[i] = fcntl(i, F_DUPFD_CLOEXEC, 10);
+            dup2(stdFDs[i], i);
+            close(stdFDs[i]);
+        }
+    }
+    return 0;
+}
+
+//puts back the descriptors RedirectShell() saved
+void RestoreShell(int *savedFDs) {
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = 0; i < 3; i++) {
+        if (savedFDs[i] != -1) {
+            dup2(savedFDs[i], i);
+            close(savedFDs[i]);
+        }
+    }
+    if (savedFDs[0] != -1)
+        clearerr(stdin);
+}
+
+//built-in command 'echo' - prints its arguments; -n leaves out the newline
+int CommandEcho(int argc, char **argv) {
+    int i = 1;
+    int isNewline = 1;
+    if (argc > 1 && strcmp(argv[1], "-n") == 0) {
+        isNewline = 0;
+        i++;
+    }
+    for (; i < argc; i++) {
+        fputs(argv[i], stdout);
+        if (i < argc - 1)
+            putchar(' ');
+    }
+    if (isNewline)
+        putchar('\n');
+    return 0;
+}
+
+//built-in commands 'true' and 'false'
+int CommandTrue(int argc, char **argv) {
+    return 0;
+}
+
+int CommandFalse(int argc, char **argv) {
+    return 1;
+}
+
+//built-in command 'pwd' - prints the working directory
+int CommandPwd(int argc, char **argv) {
+    char *directory = getcwd(NULL, 0);
+    if (directory == NULL) {
+        perror("pwd");
+        return 1;
+    }
+    printf("%s\n", directory);
+    free(directory);
+    return 0;
+}
+
+//built-in commands 'test' and '[' - POSIX rules by argument count: 0 is false, 1 is true if not empty,
+//then "! expr", "-op arg" and "arg -op arg". returns 0 for true, 1 for false, 2 for a bad expression
+int CommandTest(int argc, char **argv) {
+    if (strcmp(argv[0], "[") == 0) {
+        if (strcmp(argv[argc - 1], "]") != 0) {
+            fprintf(stderr, "[: missing ']'\n");
+            return 2;
+        }
+        argc--;
+    }
+    argv++;
+    argc--;
+
+    int isNegated = 0;
+    if (argc >= 2 && argc <= 4 && strcmp(argv[0], "!") == 0 && !(argc == 3 && TestBinary(argv[0], argv[1], argv[2]) != 2)) {
+        isNegated = 1;
+        argv++;
+        argc--;
+    }
+
+    int result;
+    if (argc == 0)
+        result = 1;
+    else if (argc == 1)
+        result = (argv[0][0] == '\0');
+    else if (argc == 2)
+        result = TestUnary(argv[0], argv[1]);
+    else if (argc == 3)
+        result = TestBinary(argv[0], argv[1], argv[2]);
+    else {
+        fprintf(stderr, "test: too many arguments\n");
+        result = 2;
+    }
+
+    if (isNegated && result != 2)
+        result = !result;
+    return result;
+}
+
+//"-op arg" for test: file checks and string length. 0 true, 1 false, 2 unknown operator
+int TestUnary(char *op, char *arg) {
+    struct stat fileInfo;
+    if (strcmp(op, "-z") == 0)
+        return arg[0] != '\0';
+    if (strcmp(op, "-n") == 0)
+        return arg[0] == '\0';
+    if (strcmp(op, "-r") == 0)
+        return access(arg, R_OK) != 0;
+    if (strcmp(op, "-w") == 0)
+        return access(arg, W_OK) != 0;
+    if (strcmp(op, "-x") == 0)
+        return access(arg, X_OK) != 0;
+    if (strcmp(op, "-L") == 0 || strcmp(op, "-h") == 0)
+        return !(lstat(arg, &fileInfo) == 0 && S_ISLNK(fileInfo.st_mode));
+
+    if (strcmp(op, "-e") != 0 && strcmp(op, "-f") != 0 && strcmp(op, "-d") != 0 && strcmp(op, "-s") != 0) {
+        fprintf(stderr, "test: %s: unary operator expected\n", op);
+        return 2;
+    }
+    if (stat(arg, &fileInfo) != 0)
+        return 1;
+    if (op[1] == 'f')
+        return !S_ISREG(fileInfo.st_mode);
+    if (op[1] == 'd')
+        return !S_ISDIR(fileInfo.st_mode);
+    if (op[1] == 's')
+        return !(fileInfo.st_size > 0);
+    return 0;
+}
+
+//"arg -op arg" for test: string and integer comparisons. 0 true, 1 false, 2 unknown operator or not a number
+int TestBinary(char *left, char *op, char *right) {
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0)
+        return strcmp(left, right) != 0;
+    if (strcmp(op, "!=") == 0)
+        return strcmp(left, right) == 0;
 
-                //redirect and verify success
-                if (dup2(fileDescriptor, 0) == -1) {
-                    fprintf(stderr, "command failed: redirection of stdin failed.\n");
-                    exit(EXIT_FAILURE);
+    static char *integerOps[] = {"-eq", "-ne", "-lt", "-le", "-gt", "-ge"};
+    int which = -1;
+    for (int i = 0; i < 6; i++) {
+        if (strcmp(op, integerOps[i]) == 0)
+            which = i;
+    }
+    if (which == -1) {
+        if (strcmp(left, "!") != 0)
+            fprintf(stderr, "test: %s: binary operator expected\n", op);
+        return 2;
+    }
+
+    char *leftEnd, *rightEnd;
+    long long a = strtoll(left, &leftEnd, 10);
+    long long b = strtoll(right, &rightEnd, 10);
+    if (left[0] == '\0' || *leftEnd != '\0' || right[0] == '\0' || *rightEnd != '\0') {
+        fprintf(stderr, "test: integer expression expected\n");
+        return 2;
+    }
+    switch (which) {
+        case 0: return !(a == b);
+        case 1: return !(a != b);
+        case 2: return !(a < b);
+        case 3: return !(a <= b);
+        case 4: return !(a > b);
+        default: return !(a >= b);
+    }
+}
+
+//built-in command 'printf' - "printf format [args...]" with backslash escapes and %d %i %u %o %x %X %c %s %e %f %g
+//%% conversions (flags, width and precision included). the format is reused until all args are consumed
+int CommandPrintf(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "printf: usage: printf format [arguments]\n");
+        return 1;
+    }
+
+    int status = 0;
+    int next = 2;
+    do {
+        int isConsuming = 0;
+        for (char *in = argv[1]; *in != '\0'; ) {
+            if (*in == '\\') {
+                in = PrintfEscape(in);
+                continue;
+            }
+            if (*in != '%') {
+                putchar(*in++);
+                continue;
+            }
+            if (in[1] == '%') {
+                putchar('%');
+                in += 2;
+                continue;
+            }
+
+            //copy one conversion spec out to hand it to the C library's printf
+            char spec[64];
+            size_t specLength = 1 + strspn(in + 1, "-+ #0");
+            specLength += strspn(in + specLength, "0123456789");
+            if (in[specLength] == '.')
+                specLength += 1 + strspn(in + specLength + 1, "0123456789");
+            char conversion = in[specLength];
+            if (conversion == '\0' || strchr("diouxXcseEfgG", conversion) == NULL || specLength + 3 > sizeof(spec)) {
+                fprintf(stderr, "printf: %.*s: invalid conversion\n", (int) specLength + 1, in);
+                return 1;
+            }
+            char *arg = (next < argc) ? argv[next++] : "";
+            isConsuming = 1;
+
+            if (strchr("diouxX", conversion) != NULL) {
+                memcpy(spec, in, specLength);
+                memcpy(spec + specLength, "ll", 2);
+                spec[specLength + 2] = conversion;
+                spec[specLength + 3] = '\0';
+                char *end;
+                long long value = (arg[0] == '\'' || arg[0] == '"') ? (unsigned char) arg[1] : strtoll(arg, &end, 0);
+                if (arg[0] != '\'' && arg[0] != '"' && arg[0] != '\0' && *end != '\0') {
+                    fprintf(stderr, "printf: %s: invalid number\n", arg);
+                    status = 1;
                 }
+                printf(spec, value);
             }
-            //stdout
             else {
-                fileDescriptor = open(commandArgs[i+1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
-                if (fileDescriptor == -1) {
-                    fprintf(stderr, "command failed: cannot open '%s' as output\n", commandArgs[i+1]);
-                    exit(EXIT_FAILURE);
-                }
+                memcpy(spec, in, specLength + 1);
+                spec[specLength + 1] = '\0';
+                if (conversion == 's')
+                    printf(spec, arg);
+                else if (conversion == 'c')
+                    printf(spec, arg[0]);
+                else
+                    printf(spec, strtod(arg, NULL));
+            }
+            in += specLength + 1;
+        }
+        if (!isConsuming)
+            break;
+    } while (next < argc);
 
-                //redirect and verify success
-                if (dup2(fileDescriptor, 1) == -1) {
-                    fprintf(stderr, "command failed: redirection of stdout failed.\n");
-                    exit(EXIT_FAILURE);
-                }
+    return status;
+}
+
+//prints the character for the backslash escape at in, returns where the format continues
+char* PrintfEscape(char *in) {
+    static char escapes[] = "n\nt\tr\r\\\\a\ab\bf\fv\v\"\"";
+    for (int i = 0; escapes[i] != '\0'; i += 2) {
+        if (in[1] == escapes[i]) {
+            putchar(escapes[i + 1]);
+            return in + 2;
+        }
+    }
+    putchar('\\');
+    return in + 1;
+}
+
+//applies the redirections of one stage, in order, to stdFDs (the descriptors the command gets as 0, 1 and 2;
+//-1 means the shell's own). files are opened in the shell itself, close-on-exec, and every descriptor put in
+//stdFDs is a new one marked in isOwned for the caller to close. returns 0 on success, -1 if something can't be
+//opened (then nothing is left open and stdFDs is back to what was passed in)
+int ManageRedirection(struct Stage *stage, int *stdFDs, int *isOwned) {
+    int fileDescriptor; //file descriptors
+    int defaultFDs[3] = {stdFDs[0], stdFDs[1], stdFDs[2]};
+
+    for (int i = 0; i < stage->redirectCount; i++) {
+        struct Redirection *redirection = &redirections[stage->redirectStart + i];
+        int target = redirection->targetFD;
+
+        switch (redirection->type) {
+            case REDIRECT_READ:
+                fileDescriptor = open(redirection->fileName, O_RDONLY | O_CLOEXEC);
+                if (fileDescriptor == -1)
+                    fprintf(stderr, "command failed: cannot open '%s' as input\n", redirection->fileName);
+                break;
+
+            case REDIRECT_WRITE:
+            case REDIRECT_APPEND:
+                fileDescriptor = open(redirection->fileName, O_WRONLY | O_CREAT | O_CLOEXEC |
+                                      (redirection->type == REDIRECT_APPEND ? O_APPEND : O_TRUNC), 0644);
+                if (fileDescriptor == -1)
+                    fprintf(stderr, "command failed: cannot open '%s' as output\n", redirection->fileName);
+                break;
+
+            //copy of what stdout is right now, so "> file 2>&1" and "2>&1 > file" differ like in other shells
+            case REDIRECT_DUP:
+                fileDescriptor = fcntl(stdFDs[1] != -1 ? stdFDs[1] : STDOUT_FILENO, F_DUPFD_CLOEXEC, 3);
+                if (fileDescriptor == -1)
+                    fprintf(stderr, "command failed: cannot redirect stderr to stdout\n");
+                break;
+
+            default:
+                fileDescriptor = HereString(redirection->fileName);
+                if (fileDescriptor == -1)
+                    fprintf(stderr, "command failed: cannot set up here-string\n");
+                break;
+        }
+
+        if (fileDescriptor == -1) {
+            for (int j = 0; j < 3; j++) {
+                if (isOwned[j])
+                    close(stdFDs[j]);
+                stdFDs[j] = defaultFDs[j];
+                isOwned[j] = 0;
+            }
+            return -1;
+        }
+
+        //a later redirection of the same stream wins
+        if (isOwned[target])
+            close(stdFDs[target]);
+        stdFDs[target] = fileDescriptor;
+        isOwned[target] = 1;
+    }
+
+    return 0;
+}
+
+//returns a descriptor to read text plus a newline from, for "<<< text". a pipe is enough when the text fits in
+//its buffer (the write can't block on an empty pipe); longer text goes into a memfd. no process or file involved
+int HereString(char *text) {
+    size_t length = strlen(text);
+    int fds[2];
+
+    if (length + 1 <= PIPE_BUF * 16 && pipe2(fds, O_CLOEXEC) == 0) {
+        if (fcntl(fds[1], F_GETPIPE_SZ) > (int) length) {
+            ssize_t written = write(fds[1], text, length);
+            written += write(fds[1], "\n", 1);
+            close(fds[1]);
+            if (written == (ssize_t) length + 1)
+                return fds[0];
+        }
+        else
+            close(fds[1]);
+        close(fds[0]);
+    }
+
+    int memoryFD = memfd_create("here-string", MFD_CLOEXEC);
+    if (memoryFD == -1)
+        return -1;
+    size_t written = 0;
+    while (written < length) {
+        ssize_t count = write(memoryFD, text + written, length - written);
+        if (count <= 0) {
+            close(memoryFD);
+            return -1;
+        }
+        written += count;
+    }
+    if (write(memoryFD, "\n", 1) != 1 || lseek(memoryFD, 0, SEEK_SET) == -1) {
+        close(memoryFD);
+        return -1;
+    }
+    return memoryFD;
+}
+
+//starts one command with stdin/stdout/stderr connected to stdFDs (-1 keeps the shell's own). posix_spawn applies
+//the redirections as file actions and the signal setup as spawn attributes, without copying the shell's memory.
+//falls back to fork() if forced with SMALLSH_LAUNCH=fork or for scripts without #! that only execvp can run.
+//returns the child's pid, or -1 if nothing could be launched (error already printed)
+pid_t LaunchCommand(char **args, int *stdFDs) {
+    pid_t spawnpid = -5;
+
+    //find where the command lives (remembered after the first search of PATH)
+    char *path = LookupCommandPath(args[0]);
+    if (path == NULL) {
+        //catch for if exec() fails due to invalid command
+        fprintf(stderr, "command failed: command '%s' is invalid\n", args[0]);
+        return -1;
+    }
+    if (path != args[0])
+        PathCacheSlot(args[0])->hits++;
+
+    //a big glob can make more argv than exec() takes; say so instead of "invalid command"
+    long argBytes = sizeof(char*);
+    for (int i = 0; args[i] != NULL; i++)
+        argBytes += strlen(args[i]) + 1 + sizeof(char*);
+    if (argBytes > argMaxBytes) {
+        fprintf(stderr, "command failed: argument list too long for '%s' (%ld bytes, limit %ld); "
+                "try \"parallel %s ::: ...\" to run it in batches\n", args[0], argBytes, argMaxBytes, args[0]);
+        return -1;
+    }
+
+    if (launchMethod == LAUNCH_SPAWN) {
+        posix_spawn_file_actions_t fileActions;
+        posix_spawn_file_actions_init(&fileActions);
+        for (int i = 0; i < 3; i++) {
+            if (stdFDs[i] != -1)
+                posix_spawn_file_actions_adddup2(&fileActions, stdFDs[i], i);
+        }
+
+        posix_spawnattr_t *spawnAttr = isBackgroundTask ? &spawnAttrBackground : &spawnAttrForeground;
+        int spawnError = posix_spawn(&spawnpid, path, &fileActions, spawnAttr, args, environ);
+
+        //remembered binary is gone: forget it and search PATH again once, like bash does
+        if (spawnError == ENOENT && path != args[0]) {
+            ForgetCommandPath(args[0]);
+            path = LookupCommandPath(args[0]);
+            if (path != NULL)
+                spawnError = posix_spawn(&spawnpid, path, &fileActions, spawnAttr, args, environ);
+        }
+        posix_spawn_file_actions_destroy(&fileActions);
+
+        if (spawnError == 0)
+            return spawnpid;
+        if (spawnError != ENOEXEC && spawnError != ENOSYS) {
+            //catch for if exec() fails due to invalid command
+            fprintf(stderr, "command failed: command '%s' is invalid\n", args[0]);
+            return -1;
+        }
+    }
+
+    //fork path can't see a failed exec from here, so check the remembered binary is still there first
+    if (launchMethod == LAUNCH_FORK && path != args[0] && access(path, X_OK) != 0) {
+        ForgetCommandPath(args[0]);
+        if ((path = LookupCommandPath(args[0])) == NULL)
+            path = args[0];
+    }
+
+    spawnpid = fork();
+    switch (spawnpid) {
+        //fork error - no child process created, parent keeps going
+        case -1:
+            perror("Hull Breach!");
+            return -1;
+
+        case 0: //child process runs
+            ChildExecute(args, path, stdFDs);
+            printf("child exec() did not exit normally - something not caught!\n");
+            fflush(stdout);
+            exit(0);
+
+        default: //parent process runs
+            return spawnpid;
+    }
+}
+
+//launches every stage of the pipeline at once, connecting stdout of each stage to stdin of the next with a pipe
+void ExecutePipeline() {
+    pid_t *stagePids = (pid_t*) malloc(stageCount * sizeof(pid_t));
+    int inputFD = -1; //read end of the pipe from the previous stage
+
+    //anything the shell printed must come out before the children's output (no prompt flush in script mode)
+    fflush(stdout);
+    clock_gettime(CLOCK_MONOTONIC, &launchTime);
+
+    //background tasks read from and write to /dev/null by default, at the ends of the pipeline
+    int nullFD = -1;
+    if (isBackgroundTask == 1) {
+        nullFD = open("/dev/null", O_RDWR | O_CLOEXEC);
+        if (nullFD == -1) {
+            fprintf(stderr, "command failed: cannot open '/dev/null' for background task.\n");
+            free(stagePids);
+            return;
+        }
+    }
+
+    //SIGTSTP is ignored while launching so children start out ignoring it, as posix_spawn can only reset
+    //signals to default. it is blocked at the same time so a ctrl+z in this window is delivered afterwards
+    sigset_t stopSignal;
+    sigemptyset(&stopSignal);
+    sigaddset(&stopSignal, SIGTSTP);
+    sigprocmask(SIG_BLOCK, &stopSignal, NULL);
+    struct sigaction SIGTSTP_ignore = {0}, SIGTSTP_shell;
+    SIGTSTP_ignore.sa_handler = SIG_IGN;
+    sigaction(SIGTSTP, &SIGTSTP_ignore, &SIGTSTP_shell);
+
+    int i;
+    for (i = 0; i < stageCount; i++) {
+        char **stageArgs = &commandArgs[stages[i].argStart];
+
+        //pipe to the next stage, unless this is the last one
+        int pipeFDs[2] = {-1, -1};
+        if (i < stageCount - 1) {
+            if (pipe2(pipeFDs, O_CLOEXEC) == -1) {
+                perror("Hull Breach!");
+                break;
             }
+            if (pipeBufferSize > 0)
+                fcntl(pipeFDs[1], F_SETPIPE_SZ, pipeBufferSize); //best effort; kernel may cap the size
+        }
 
-            //reorganize command argument array after processing redirection
-            argsCount -= 2;
-            for (int j = i; j < argsCount; j++)
-                commandArgs[j] = commandArgs[j+2];
-            //these need to point to NULL otherwise exel() keeps reading them
-            commandArgs[argsCount] = NULL;
-            commandArgs[argsCount+1] = NULL;
+        //explicit redirection beats the pipe, which beats /dev/null for background tasks
+        int stdFDs[3] = {(inputFD != -1) ? inputFD : (i == 0) ? nullFD : -1,
+                         (pipeFDs[1] != -1) ? pipeFDs[1] : (i == stageCount - 1) ? nullFD : -1, -1};
+        int isOwned[3] = {0, 0, 0};
+        if (ManageRedirection(&stages[i], stdFDs, isOwned) == -1)
+            stagePids[i] = -1;
+        else
+            stagePids[i] = LaunchCommand(stageArgs, stdFDs);
 
-            i--; //rerun at the same index
+        //shell drops its copies of everything now owned by the child
+        for (int j = 0; j < 3; j++) {
+            if (isOwned[j])
+                close(stdFDs[j]);
         }
+        if (inputFD != -1)
+            close(inputFD);
+        if (pipeFDs[1] != -1)
+            close(pipeFDs[1]);
+        inputFD = pipeFDs[0];
     }
+    if (inputFD != -1)
+        close(inputFD);
+    if (nullFD != -1)
+        close(nullFD);
+
+    sigaction(SIGTSTP, &SIGTSTP_shell, NULL);
+    sigprocmask(SIG_UNBLOCK, &stopSignal, NULL);
+
+    if (i > 0)
+        ProcessHandler(stagePids, i);
+    free(stagePids);
 }
 
-//Helps the shell process handle foreground and background processes
-void ProcessHandler(pid_t spawnpid) {
+//Helps the shell process handle foreground and background processes. pids are the stages of one pipeline
+void ProcessHandler(pid_t *spawnpids, int count) {
     int childExitMethod = -5;
 
-    //foreground task: shell needs to wait for finish
+    //foreground task: shell needs to wait for all stages to finish; the last stage decides the status.
+    //a stage that could not be launched (pid -1) counts as having failed with exit status 1
     if (!isBackgroundTask) {
-        waitpid(spawnpid, &childExitMethod, 0);
+        struct rusage stageUsage;
+        memset(&lastUsage, 0, sizeof(lastUsage));
+        for (int i = 0; i < count; i++) {
+            if (spawnpids[i] == -1)
+                childExitMethod = W_EXITCODE(EXIT_FAILURE, 0);
+            else if (wait4(spawnpids[i], &childExitMethod, 0, &stageUsage) > 0)
+                AddUsage(&lastUsage, &stageUsage);
+        }
+        SetWallTime(&lastUsage, &launchTime);
 
         //check and record exit status
         if (WIFEXITED(childExitMethod)) {
@@ -293,41 +1811,178 @@ void ProcessHandler(pid_t spawnpid) {
     }
     //background task handling
     else {
-        //print out beginning of background running task
-        printf("background task pid is '%d'\n", (int)spawnpid);
+        for (int i = 0; i < count; i++) {
+            if (spawnpids[i] == -1)
+                continue;
 
-        //slot it into the most recent available element in bg array for the records
-        for (int i = 0; i < BG_PID_SIZE; i++) {
-            if (bgPid[i] == 0) {
-                bgPid[i] = (int) spawnpid;
-                break;
-            }
+            //print out beginning of background running task
+            printf("background task pid is '%d'\n", (int)spawnpids[i]);
+
+            //keep it in the job table for the records, reaped later via SIGCHLD
+            struct Job job = {spawnpids[i], launchTime, isTimedTask};
+            JobAdd(job);
         }
     }
 }
 
-//Check background processes for completion
+//Check background processes for completion. only runs waitpid for children that actually exited, as
+//announced on sigchldFD, so the cost does not grow with the number of jobs still running
 void CheckBGProcesses() {
     int bgExitStatus;
     int childExitMethod = -5;
+    pid_t donePid;
+    struct rusage doneUsage;
+    struct Job doneJob;
 
-    for (int i = 0; i < BG_PID_SIZE; i++) {
-        if (waitpid(bgPid[i], &childExitMethod, WNOHANG) > 0) {
-            //check and record exit status
-            if (WIFEXITED(childExitMethod)) {
-                bgExitStatus = WEXITSTATUS(childExitMethod);
-                printf("background pid %d is done with exit status: %d\n", bgPid[i], bgExitStatus);
-            }
-            else if (WIFSIGNALED(childExitMethod)) {
-                bgExitStatus = WTERMSIG(childExitMethod);
-                printf("background pid %d is done with signal termination: %d\n", bgPid[i], bgExitStatus);
-            }
+    //drain pending SIGCHLD notifications; several exits may be coalesced into one, so reap until none are left
+    struct signalfd_siginfo info;
+    int isAnyExited = 0;
+    while (read(sigchldFD, &info, sizeof(info)) == sizeof(info))
+        isAnyExited = 1;
+    if (!isAnyExited && !isChildExitPending)
+        return;
+    isChildExitPending = 0;
+
+    while ((donePid = wait4(-1, &childExitMethod, WNOHANG, &doneUsage)) > 0) {
+        if (!JobRemove(donePid, &doneJob))
+            continue; //not a background job
 
-            bgPid[i] = 0; //remove completed bg pid for new bg processes to use
+        //check and record exit status
+        if (WIFEXITED(childExitMethod)) {
+            bgExitStatus = WEXITSTATUS(childExitMethod);
+            printf("background pid %d is done with exit status: %d\n", (int) donePid, bgExitStatus);
+        }
+        else if (WIFSIGNALED(childExitMethod)) {
+            bgExitStatus = WTERMSIG(childExitMethod);
+            printf("background pid %d is done with signal termination: %d\n", (int) donePid, bgExitStatus);
         }
+
+        //"time cmd &": usage as of reaping, so wall time includes any wait for the next prompt
+        if (doneJob.isTimed) {
+            struct JobUsage jobUsage;
+            memset(&jobUsage, 0, sizeof(jobUsage));
+            AddUsage(&jobUsage, &doneUsage);
+            SetWallTime(&jobUsage, &doneJob.startTime);
+            PrintUsage(&jobUsage);
+        }
+    }
+    fflush(stdout);
+}
+
+//allocates an empty job table with given number of slots (power of 2)
+void JobTableInit(int size) {
+    jobTable = (struct Job*) calloc(size, sizeof(struct Job));
+    jobTableSize = size;
+    jobTableUsed = 0;
+}
+
+//records a background job; linear probing from the pid's hash
+void JobAdd(struct Job job) {
+    //grow (or just clean out deleted markers) before the table gets too full to probe quickly
+    if ((jobTableUsed + 1) * 4 > jobTableSize * 3) {
+        struct Job *oldTable = jobTable;
+        int oldSize = jobTableSize;
+        int liveCount = 0;
+        for (int i = 0; i < oldSize; i++)
+            liveCount += (oldTable[i].pid > 0);
+
+        JobTableInit((liveCount + 1) * 2 > oldSize ? oldSize * 2 : oldSize);
+        for (int i = 0; i < oldSize; i++) {
+            if (oldTable[i].pid > 0)
+                JobAdd(oldTable[i]);
+        }
+        free(oldTable);
+    }
+
+    unsigned int slot = ((unsigned int) job.pid * 2654435761u) & (jobTableSize - 1);
+    while (jobTable[slot].pid > 0)
+        slot = (slot + 1) & (jobTableSize - 1);
+    if (jobTable[slot].pid == 0)
+        jobTableUsed++;
+    jobTable[slot] = job;
+}
+
+//forgets a background pid; returns 1 and a copy of its record if it was in the table
+int JobRemove(pid_t pid, struct Job *removed) {
+    unsigned int slot = ((unsigned int) pid * 2654435761u) & (jobTableSize - 1);
+    while (jobTable[slot].pid != 0) {
+        if (jobTable[slot].pid == pid) {
+            *removed = jobTable[slot];
+            jobTable[slot].pid = -1;
+            return 1;
+        }
+        slot = (slot + 1) & (jobTableSize - 1);
+    }
+    return 0;
+}
+
+//adds one process's rusage from wait4() into a job's totals
+void AddUsage(struct JobUsage *usage, struct rusage *processUsage) {
+    timeradd(&usage->userTime, &processUsage->ru_utime, &usage->userTime);
+    timeradd(&usage->systemTime, &processUsage->ru_stime, &usage->systemTime);
+    if (processUsage->ru_maxrss > usage->maxRss)
+        usage->maxRss = processUsage->ru_maxrss;
+    usage->voluntarySwitches += processUsage->ru_nvcsw;
+    usage->involuntarySwitches += processUsage->ru_nivcsw;
+}
+
+//sets a job's wall time to the time elapsed since it started
+void SetWallTime(struct JobUsage *usage, struct timespec *startTime) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    usage->wallTime.tv_sec = now.tv_sec - startTime->tv_sec;
+    usage->wallTime.tv_nsec = now.tv_nsec - startTime->tv_nsec;
+    if (usage->wallTime.tv_nsec < 0) {
+        usage->wallTime.tv_sec--;
+        usage->wallTime.tv_nsec += 1000000000L;
     }
 }
 
+//prints resources used by a job, for "time" and "status -v"
+void PrintUsage(struct JobUsage *usage) {
+    printf("real\t%ld.%03lds\n", (long) usage->wallTime.tv_sec, usage->wallTime.tv_nsec / 1000000);
+    printf("user\t%ld.%03lds\n", (long) usage->userTime.tv_sec, (long) usage->userTime.tv_usec / 1000);
+    printf("sys\t%ld.%03lds\n", (long) usage->systemTime.tv_sec, (long) usage->systemTime.tv_usec / 1000);
+    printf("max rss\t%ld KB\n", usage->maxRss);
+    printf("context switches\t%ld voluntary, %ld involuntary\n", usage->voluntarySwitches, usage->involuntarySwitches);
+    fflush(stdout);
+}
+
+//called before a command that runs in the shell itself (cd, status, echo, parallel...), to measure it
+void StartShellCommand() {
+    clock_gettime(CLOCK_MONOTONIC, &launchTime);
+    getrusage(RUSAGE_SELF, &shellStartUsage);
+    getrusage(RUSAGE_CHILDREN, &childrenStartUsage);
+}
+
+//called after an in-shell command: its usage is what the shell, and the children it reaped meanwhile (the jobs
+//of "parallel"), used since StartShellCommand(). it becomes the one "status -v" shows unless isKept is 0, and
+//is printed after "time"
+void FinishShellCommand(int isKept) {
+    struct JobUsage usage;
+    struct rusage now[2], *start[2] = {&shellStartUsage, &childrenStartUsage};
+    memset(&usage, 0, sizeof(usage));
+    getrusage(RUSAGE_SELF, &now[0]);
+    getrusage(RUSAGE_CHILDREN, &now[1]);
+    for (int i = 0; i < 2; i++) {
+        timersub(&now[i].ru_utime, &start[i]->ru_utime, &now[i].ru_utime);
+        timersub(&now[i].ru_stime, &start[i]->ru_stime, &now[i].ru_stime);
+        now[i].ru_nvcsw -= start[i]->ru_nvcsw;
+        now[i].ru_nivcsw -= start[i]->ru_nivcsw;
+    }
+    //the children's peak covers every child ever reaped, so it only counts when one of this command's was bigger
+    if (now[1].ru_maxrss == childrenStartUsage.ru_maxrss)
+        now[1].ru_maxrss = 0;
+    AddUsage(&usage, &now[0]);
+    AddUsage(&usage, &now[1]);
+    SetWallTime(&usage, &launchTime);
+
+    if (isKept)
+        lastUsage = usage;
+    if (isTimedTask)
+        PrintUsage(&usage);
+}
+
 //function on handling SIGTSTP to use as enable/disable background processes
 void CatchStopSigForBackgroundToggle(int signo) {
     if (isBackgroundEnabled) {
@@ -345,7 +2000,11 @@ void CatchStopSigForBackgroundToggle(int signo) {
 
 
 ////Main - primary shell process
-int main() {
+//usage: smallsh                 interactive, prompts with ": "
+//       smallsh script          runs the commands in file script
+//       smallsh -c "commands"   runs the given commands (one per line)
+//in both script modes the shell exits at the end with the status of the last foreground command
+int main(int argc, char *argv[]) {
     //shell signal setup for SIGINT (ctrl+c) to be ignored
     struct sigaction SIGINT_action = {0};
     SIGINT_action.sa_handler = SIG_IGN;
@@ -357,20 +2016,74 @@ int main() {
     SIGTSTP_action.sa_flags = SA_RESTART; //this prevents function from failing if ctrl+z while waiting child
     sigaction(SIGTSTP, &SIGTSTP_action, NULL);
 
+    //optional larger pipe buffers for pipelines
+    if (getenv(PIPE_SIZE_ENV) != NULL)
+        pipeBufferSize = atoi(getenv(PIPE_SIZE_ENV));
+
+    //SIGCHLD is blocked and read from a signalfd instead, so finished background jobs can be reaped
+    //without polling each one; children get the normal mask back before exec
+    sigset_t childSignals;
+    sigemptyset(&childSignals);
+    sigaddset(&childSignals, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &childSignals, &childSignalMask);
+    sigchldFD = signalfd(-1, &childSignals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sigchldFD == -1) {
+        perror("Hull Breach!");
+        exit(EXIT_FAILURE);
+    }
+
+    //pick launch path and prepare the posix_spawn signal setup shared by every command
+    if (getenv(LAUNCH_ENV) != NULL && strcmp(getenv(LAUNCH_ENV), "fork") == 0)
+        launchMethod = LAUNCH_FORK;
+    sigset_t interruptSignal;
+    sigemptyset(&interruptSignal);
+    sigaddset(&interruptSignal, SIGINT);
+    posix_spawnattr_init(&spawnAttrForeground);
+    posix_spawnattr_setflags(&spawnAttrForeground, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+    posix_spawnattr_setsigmask(&spawnAttrForeground, &childSignalMask);
+    posix_spawnattr_setsigdefault(&spawnAttrForeground, &interruptSignal);
+    posix_spawnattr_init(&spawnAttrBackground);
+    posix_spawnattr_setflags(&spawnAttrBackground, POSIX_SPAWN_SETSIGMASK);
+    posix_spawnattr_setsigmask(&spawnAttrBackground, &childSignalMask);
+
+    //script modes: whole input is in memory up front, nothing is read from stdin
+    if (argc >= 2) {
+        isScriptMode = 1;
+        if (strcmp(argv[1], "-c") == 0) {
+            if (argc < 3) {
+                fprintf(stderr, "smallsh: -c requires an argument\n");
+                exit(2);
+            }
+            scriptText = argv[2];
+            scriptLength = strlen(argv[2]);
+        }
+        else
+            LoadScript(argv[1]);
+    }
+
     int exitShell = 0;
-    //initiate w/ 0 to clear bg process records
-    for (int i = 0; i < BG_PID_SIZE; i++)
-        bgPid[i] = 0;
+    shellPidLength = snprintf(shellPid, sizeof(shellPid), "%d", (int) getpid()); //for $$ expansion
+    argMaxBytes = sysconf(_SC_ARG_MAX) - ARG_MAX_HEADROOM;
+    for (char **variable = environ; *variable != NULL; variable++)
+        argMaxBytes -= strlen(*variable) + 1 + sizeof(char*);
+    commandPromptSize = PARSE_MIN_SIZE;
+    commandPrompt = (char*) malloc(commandPromptSize);
+    JobTableInit(JOB_TABLE_MIN_SIZE); //empty bg process records
+    PathCacheClear(); //empty command path cache
 
     //main shell loop
     while (exitShell == 0) {
         CheckBGProcesses();
         UserInput(); //flushes everything and sets prompt
+        if (isEndOfInput)
+            break;
         ParseCommandPrompt(); //parses prompt
 
         //kills all bg child processes, then exits shell if user specifies 'exit' command
         if (strcmp(commandArgs[0], "exit") == 0 && argsCount == 1) {
+            StartShellCommand();
             CommandExit();
+            FinishShellCommand(1);
             exitShell = 1;
         }
 
@@ -386,41 +2099,59 @@ int main() {
             continue;
 
         //built-in command cd to change directory
-        else if (strcmp(commandArgs[0], "cd") == 0) {
+        else if (strcmp(commandArgs[0], "cd") == 0 && stageCount == 1) {
+            StartShellCommand();
             CommandCd();
+            FinishShellCommand(1);
         }
 
-        //built-in command to display exit status
-        else if (strcmp(commandArgs[0], "status") == 0) {
+        //built-in command to display exit status. it reports on the command before it, so that one stays last
+        else if (strcmp(commandArgs[0], "status") == 0 && stageCount == 1) {
+            StartShellCommand();
             CommandStatus();
+            FinishShellCommand(0);
+        }
+
+        //built-in command to show or reset remembered command locations
+        else if (strcmp(commandArgs[0], "hash") == 0 && stageCount == 1) {
+            StartShellCommand();
+            CommandHash();
+            FinishShellCommand(1);
         }
 
-        //fork and execute other command
+        //built-in command to run one command over many inputs, N at a time
+        else if (strcmp(commandArgs[0], "parallel") == 0 && stageCount == 1) {
+            StartShellCommand();
+            CommandParallel();
+            FinishShellCommand(1);
+        }
+
+        //echo, test, printf and friends run in the shell itself when nothing needs a separate process
+        //(pipelines and background tasks still launch the real commands); "time" wants a process to measure
+        else if (stageCount == 1 && !isBackgroundTask && !isTimedTask && FindUtilityBuiltin(commandArgs[0]) != NULL) {
+            StartShellCommand();
+            RunUtilityBuiltin(FindUtilityBuiltin(commandArgs[0]));
+            FinishShellCommand(1);
+        }
+
+        //fork and execute other command, or every command of a pipeline
         else {
-            pid_t spawnpid = -5;
-            spawnpid = fork();
-
-            switch (spawnpid) {
-                //fork error - no child process created, parent keeps going
-                case -1:
-                    perror("Hull Breach!");
-                    break;
-
-                case 0: //child process runs
-                    ChildExecute(spawnpid);
-                    printf("child exec() did not exit normally - something not caught!\n");
-                    fflush(stdout);
-                    exit(0);
-                    break;
-
-                default: //parent process runs
-                    ProcessHandler(spawnpid);
-                    break;
-            }
+            ExecutePipeline();
+            if (isTimedTask && !isBackgroundTask)
+                PrintUsage(&lastUsage);
         }
     }
 
     free(commandArgs);
     commandArgs = NULL;
+    free(wordArena);
+    free(patternBuffer);
+    free(stages);
+    free(redirections);
+    free(commandPrompt);
+
+    //scripts report how their last command went, shell-style: 128+signal if it was killed
+    if (isScriptMode)
+        return isTermBySignal ? 128 + exitStatus : exitStatus;
     return 0;
 }
\ No newline at end of file
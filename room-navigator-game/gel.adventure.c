@@ -1,6 +1,18 @@
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdint.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <netdb.h>
+#include <errno.h>
+#include <signal.h>
+#include <ctype.h>
 #include <unistd.h>
 #include <dirent.h>
 #include <memory.h>
@@ -11,249 +23,517 @@
 ////A. Global Variables --------------------------------------------------------------------
 #define DIRECTORY_PREFIX    "gel.rooms."
 #define DIRECTORY_PREFIX_CHAR_COUNT 10  //"gel.rooms."
-#define ROOM_COUNT    7
-#define MAX_CONNECTIONS 6
+#define LATEST_LINK "gel.latest"    //symlink gel.buildrooms points at the rooms directory it made last
+#define MIN_ROOMS_SIZE  16      //first size of the room file list; it doubles when full
+#define DIRENT_BUFFER_SIZE 65536    //bytes of directory entries fetched per getdents64 call
+#define ROOM_FILE_MIN_SIZE 256  //free space a loading thread's text arena has before each read; it doubles when full
+#define LOAD_THREAD_ROOMS 1024  //rooms directories with at least this many files are read by several threads
+#define MAX_LOAD_THREADS 16
+#define LOAD_CHUNK      64      //files a loading thread takes at a time
+#define SOLVE_THREAD_ROOMS 100000   //worlds with at least this many rooms are solved by several threads
+#define MAX_SOLVE_THREADS 16
+#define TOP_DOWN_FACTOR 14      //search from the rooms found last while they have less than 1/14 of the unseen connections
+#define BOTTOM_UP_FACTOR 24     //search from the unseen rooms until less than 1/24 of all rooms were found last
 #define TIME_FILE   "currentTime.txt"
-
-//file data will be read into struct Data
-struct Room {
-    char *name;
-    char *type;
-    struct Room **connection;
-    int connectionCount;
+#define PATH_MAGIC  "gel.path 1"    //first line of a recorded path
+#define MIN_PATH_SIZE 64        //first size of the path array; it doubles when full
+#define MIN_BUFFER_SIZE 256     //first size of an output buffer; it doubles when full
+#define INPUT_SIZE  256         //longest word read as a move; longer ones are cut
+#define BATCH_READ_SIZE (1 << 20)   //bytes of moves --batch reads at a time
+#define BATCH_OUTPUT_SIZE (1 << 16) //--batch writes the game's answers out once this much has piled up
+#define MAX_SERVER_WORKERS 64
+#define SERVER_EVENTS 64        //events a server worker takes per epoll_wait()
+#define TIME_SIZE   100         //formatted time, with room to spare
+#define WORLD_FILE  ".world"    //binary world written by gel.buildrooms next to the room files
+#define WORLD_MAGIC "GELW"
+#define WORLD_VERSION 1
+
+//room types, stored as one byte per room in the world file
+enum RoomType {MID_ROOM, START_ROOM, END_ROOM};
+
+//world file layout (same as in gel.buildrooms): this header, then
+//  uint32 nameOffsets[roomCount + 1], uint32 adjacencyOffsets[roomCount + 1], uint32 adjacency[connectionCount],
+//  uint8 types[roomCount], char names[nameBytes]
+struct WorldHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t roomCount;
+    uint32_t connectionCount;
+    uint32_t nameBytes;
+    uint32_t reserved;
 };
 
-//node for linked list for keeping track of path player takes
-struct Node {
-    struct Room *room;
-    struct Node *next;
+//the world the game runs on. rooms are numbered 0..roomCount-1 and everything about a room is found by its number:
+//name at names + nameOffsets[i], connections at adjacency[adjacencyOffsets[i] .. adjacencyOffsets[i+1]).
+//the arrays point straight into the mmap'd world file, or into the world's arena when loaded from the room files.
+//the arena is one malloc holding every array that isn't in the file, so a world is two allocations at most
+struct World {
+    int roomCount;
+    int startRoom;
+    uint32_t *nameOffsets;
+    char *names;
+    uint8_t *types;         //enum RoomType
+    uint32_t *adjacencyOffsets;
+    uint32_t *adjacency;
+    void *mapping;          //the mmap'd world file, NULL if everything is in the arena
+    size_t mappingSize;
+    char *arena;
+    uint32_t *nameSlots;    //hash table of room number + 1 by name, 0 for empty: open addressing, linear probing,
+    uint32_t nameSlotCount; //FNV-1a hash. power of 2, at least twice the number of rooms so probes stay short
+    int32_t *nextHop;       //room to go to from each room on a shortest way to the end room; -1 if there is none
+    int shortestSteps;      //steps of the shortest way from the start room, -1 if the end can't be reached
+};
+#define RoomName(world, room) ((world)->names + (world)->nameOffsets[room])
+
+//a room file as read by one of the loading threads, which keep the text of their files back to back in their arena
+struct RoomFile {
+    int arena;              //index of the text arena, -1 if the file is not a room file
+    size_t offset;          //where its text starts there
+    uint32_t length;
+    uint32_t nameLength;
+    uint32_t connectionCount;
+};
+struct TextArena {
+    char *text;
+    size_t size;
+    size_t used;
 };
 
-//mutex lock to be used in different functions
-//setup mutex lock to prevent main thread from displaying time before thread #1 records it
-pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+//kinds of lines in a room file
+enum RoomLine {LINE_END, LINE_NAME, LINE_TYPE, LINE_CONNECTION, LINE_OTHER};
+
+//files of a rooms directory shared by the loading threads. each thread takes LOAD_CHUNK files at a time
+struct RoomLoader {
+    int directoryDescriptor;
+    char **fileNames;
+    struct RoomFile *files; //files[i] is read from fileNames[i]
+    int fileCount;
+    int nextFile;           //first file nobody took yet
+    int nextArena;          //arena for the next thread that starts
+    struct TextArena arenas[MAX_LOAD_THREADS];
+    pthread_mutex_t nextLock;
+};
 
-////B. Functions To Identify Correct Rooms Directory --------------------------------------
-//function prototypes to avoid implicit declaration issues
-int RoomsDirCount();
-char* MostRecentRoomsDir();
+//shared by the threads of a parallel search. rooms are sets of bits, 64 per word; each thread owns a range of words
+struct SolveState {
+    struct World *world;
+    uint64_t *visited;      //rooms already given their next hop
+    uint64_t *frontier;     //rooms found in the last round
+    uint64_t *next;         //rooms found in this round
+    int wordCount;
+    int threadCount;
+    int isBottomUp;         //this round looks for frontier neighbors of unseen rooms instead of the other way round
+    int isDone;
+    int round;
+    long long threadFound[MAX_SOLVE_THREADS];       //rooms each thread counted in next
+    long long threadEdges[MAX_SOLVE_THREADS];       //and their connections
+    pthread_barrier_t barrier;
+};
+struct SolveArgument {
+    struct SolveState *state;
+    int index;              //0 to threadCount-1
+};
 
-//finds most recent rooms directory and returns string of directory name
-char* MostRecentRoomsDir() {
-    int count = RoomsDirCount();
-    struct stat *roomDirs = (struct stat *) malloc(count * sizeof(struct stat));
-    DIR *d;
-    struct dirent *dir;
+//growable text to be written out in one go
+struct Buffer {
+    char *text;
+    size_t length;
+    size_t size;
+};
 
-    //open current directory and error check
-    if (count == 0)
-        printf("Warning! There were no rooms directories! This might create seg fault!");
-    d = opendir(".");
-    if (d == NULL)
-        printf("Warning! Issue with opening current working directory!");
+//path the player takes, as a growable array of room numbers. rooms[0] is the start room
+struct Path {
+    uint32_t *rooms;
+    size_t count;
+    size_t size;
+};
 
-    //iterates through and grabs relevant directory information
-    char prefixMatch[DIRECTORY_PREFIX_CHAR_COUNT+1];
-    int i = 0;
-    time_t mostRecent = 0;
-    char *mostRecentDir;
-    while ((dir = readdir(d)) != NULL) {
-        //gets just the prefix of directory w/o the pid portion
-        memset(prefixMatch, '\0', sizeof(prefixMatch));
-        strncpy(prefixMatch, dir->d_name, 10);
-
-        if (strcmp(prefixMatch, DIRECTORY_PREFIX) == 0) {
-            //this would happen if this program runs before creating any rooms directory.. don't do that
-            if (stat(dir->d_name, &roomDirs[i]) < 0)
-                printf("Warning! Failed to find stat of a rooms directory");
-
-            //takes the time and directory name of most recent among all iterated directories
-            if(roomDirs[i].st_mtime > mostRecent) {
-                mostRecent = roomDirs[i].st_mtime;
-                mostRecentDir = dir->d_name;
-            }
+//the time thread: started once, it formats the time whenever the game asks and hands it back in output.
+//it then writes the time to TIME_FILE after answering, unless the game already asks again. the game only waits
+//on the disk when it asks while a write is under way
+struct TimeService {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;     //signaled when a request, an answer or the stop comes in
+    int isRequested;
+    int isAnswered;
+    int isStopping;
+    int isWritingFile;          //also keep TIME_FILE up to date; off with --no-time-file
+    char output[TIME_SIZE];
+    pthread_t thread;
+    int isRunning;
+};
+struct TimeService timeService = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, 0, 1, "", 0, 0};
+
+int isAutoplay = 0;         //--autoplay: the game walks a shortest way itself instead of asking
+char *recordFile = NULL;    //--record: path file to write the finished game to
+char *replayFile = NULL;    //--replay: path file to play back instead of asking
+char *batchFile = NULL;     //--batch: file of moves ("-" for stdin) to play in big chunks instead of asking
+int isQuiet = 0;            //--quiet: --batch shows just the end screen
+double loadSeconds = 0, solveSeconds = 0;   //how long the world took to load and solve, for --batch to report
+struct Buffer screen = {NULL, 0, 0};    //what the game shows next on the terminal
+
+//one player of the game server. all players share the world; this is all that is kept per player
+struct Session {
+    int socket;
+    struct Path path;       //rooms visited; the last one is where the player is
+    char input[INPUT_SIZE]; //word being read, which may arrive in pieces
+    int inputLength;
+    struct Buffer output;   //text not sent yet
+    size_t outputSent;
+    int isFinished;         //reached the end room; the session closes once its output is out
+};
 
-            i++; //i should never be greater than count, unless directory was modified concurrently
-        }
-    }
-    closedir(d);
+//what each server worker thread needs
+struct ServerWorker {
+    struct World *world;
+    int listenSocket;
+    pthread_t thread;
+};
 
-    //sets up a malloc char array to return out of the function the name of most recent rooms dir
-    char *recentRoom = (char*) malloc(sizeof(char)*(DIRECTORY_PREFIX_CHAR_COUNT+10));
-    memset(recentRoom, '\0', sizeof(recentRoom));
-    strcpy(recentRoom, mostRecentDir);
+////B. Functions To Identify Correct Rooms Directory --------------------------------------
+//function prototypes to avoid implicit declaration issues
+char* LatestRoomsDir();
+char* ScanRoomsDirs();
+char* MostRecentRoomsDir();
 
-    free(roomDirs); //frees what was malloc'd to hold the stats
+//finds most recent rooms directory and returns malloc'd string of directory name, NULL if there is none.
+//follows the link gel.buildrooms keeps to its newest directory; only without a usable link are all directories compared
+char* MostRecentRoomsDir() {
+    char *roomDir = LatestRoomsDir();
+    if (roomDir == NULL)
+        roomDir = ScanRoomsDirs();
+    if (roomDir == NULL)
+        printf("Warning! There were no rooms directories! Run gel.buildrooms first.\n");
+    return roomDir;
+}
 
-    return recentRoom;
+//returns the rooms directory the latest link points at, NULL if the link is missing or points to nothing usable
+char* LatestRoomsDir() {
+    char target[256];
+    ssize_t length = readlink(LATEST_LINK, target, sizeof(target) - 1);
+    if (length <= 0)
+        return NULL;
+    target[length] = '\0';
+
+    //only rooms directories right next to the link are trusted
+    struct stat dirStat;
+    if (strncmp(target, DIRECTORY_PREFIX, DIRECTORY_PREFIX_CHAR_COUNT) != 0 || strchr(target, '/') != NULL ||
+        stat(target, &dirStat) == -1 || !S_ISDIR(dirStat.st_mode))
+        return NULL;
+    return strdup(target);
 }
 
-//finds all relevant room directories and return char* array of them for further filtering
-int RoomsDirCount() {
+//finds the rooms directory with the newest modification time in one pass over the current directory
+char* ScanRoomsDirs() {
     DIR *d;
     struct dirent *dir;
 
     //open current directory and error check
     d = opendir(".");
-    if (d == NULL)
+    if (d == NULL) {
         printf("Warning! Issue with opening current working directory!");
+        return NULL;
+    }
 
-    //iterates through and gets count of relevant rooms directory
-    int count = 0;
-    char prefixMatch[DIRECTORY_PREFIX_CHAR_COUNT+1];
+    //iterates through and grabs relevant directory information
+    time_t mostRecent = 0;
+    char *mostRecentDir = NULL;
+    struct stat dirStat;
     while ((dir = readdir(d)) != NULL) {
-        //gets just the prefix of directory w/o the pid portion
-        memset(prefixMatch, '\0', sizeof(prefixMatch));
-        strncpy(prefixMatch, dir->d_name, 10);
-
-        //adds to count so get only count of relevant directories, not all of them
-        if (strcmp(prefixMatch, DIRECTORY_PREFIX) == 0)
-            count++;
+        //compare just the prefix of directory w/o the pid portion
+        if (strncmp(dir->d_name, DIRECTORY_PREFIX, DIRECTORY_PREFIX_CHAR_COUNT) != 0)
+            continue;
+        if (stat(dir->d_name, &dirStat) < 0 || !S_ISDIR(dirStat.st_mode))
+            continue;
+
+        //takes the time and directory name of most recent among all iterated directories
+        if (mostRecentDir == NULL || dirStat.st_mtime > mostRecent) {
+            mostRecent = dirStat.st_mtime;
+            free(mostRecentDir);
+            mostRecentDir = strdup(dir->d_name); //dir->d_name is gone after closedir()
+        }
     }
     closedir(d);
 
-    return count;
+    return mostRecentDir;
 }
 
 
 ////C. Functions to Bring Room Data Into Memory -----------------------------------------
 //function prototypes to avoid implicit declaration issues
-void FreeMemory(struct Room **);
 int IsHiddenFile(char*);
-void InstantiateRoomNamesTypes(char *, struct Room **);
-void InstantiateRoomConnections(char *, struct Room **);
-struct Room** FillRoomsData(char *);
-
-//given rooms directory, iterate through all files and instantiate Room structs
-struct Room** FillRoomsData(char *roomDir) {
-    struct Room **rooms = (struct Room **) malloc(ROOM_COUNT * sizeof(struct Room*));
+char* ListRoomFiles(int, char ***, int *);
+void* LoadRoomFiles(void *);
+int ReadRoomFile(int, char *, struct TextArena *, struct RoomFile *);
+int NextRoomLine(char **, char *, char **, int *);
+int FillRoomsData(char *, struct World *);
+void* ArenaTake(char **, size_t);
+void AllocateWorld(struct World *, int, size_t, size_t);
+uint32_t* NameSlot(struct World *, char *, int);
+int FindRoom(struct World *, char *, int);
+int IndexWorldNames(struct World *);
+int LoadWorldFile(char *, struct World *);
+void LoadWorld(char *, struct World *);
+void FreeWorld(struct World *);
+
+//given rooms directory, read all room files into the world. returns -1 if there is no room file to read.
+//the directory is listed once, and each file is opened relative to it and read once, by several threads in
+//big worlds. once all are read, the world's arena is sized exactly, filled with names and types, and connections
+//are looked up by name in the finished index
+int FillRoomsData(char *roomDir, struct World *world) {
+    struct RoomLoader loader;
+    loader.directoryDescriptor = open(roomDir, O_RDONLY | O_DIRECTORY);
+    if (loader.directoryDescriptor == -1) {
+        printf("Warning! Issue with opening rooms directory!");
+        return -1;
+    }
 
-    //instantiate rooms
-    InstantiateRoomNamesTypes(roomDir, rooms);
-    InstantiateRoomConnections(roomDir, rooms);
+    char *namePool = ListRoomFiles(loader.directoryDescriptor, &loader.fileNames, &loader.fileCount);
+    loader.files = (struct RoomFile*) malloc((loader.fileCount + 1) * sizeof(struct RoomFile));
+    loader.nextFile = 0;
+    loader.nextArena = 0;
+    memset(loader.arenas, 0, sizeof(loader.arenas));
+    pthread_mutex_init(&loader.nextLock, NULL);
+
+    int threadCount = 1;
+    if (loader.fileCount >= LOAD_THREAD_ROOMS) {
+        threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+        if (threadCount > MAX_LOAD_THREADS)
+            threadCount = MAX_LOAD_THREADS;
+        if (threadCount < 1)
+            threadCount = 1;
+    }
 
-    return rooms;
-}
+    //this thread loads too; the others are extra help
+    pthread_t threadIds[MAX_LOAD_THREADS];
+    int i, started = 0;
+    for (i = 1; i < threadCount; i++) {
+        if (pthread_create(&threadIds[started], NULL, LoadRoomFiles, &loader) == 0)
+            started++;
+    }
+    LoadRoomFiles(&loader);
+    for (i = 0; i < started; i++)
+        pthread_join(threadIds[i], NULL);
+    pthread_mutex_destroy(&loader.nextLock);
+    close(loader.directoryDescriptor);
+    free(loader.fileNames);
+    free(namePool);
+
+    //now the sizes are known: one arena for the whole world
+    int roomCount = 0;
+    size_t nameBytes = 0, connectionCount = 0;
+    for (i = 0; i < loader.fileCount; i++) {
+        if (loader.files[i].arena != -1) {
+            nameBytes += loader.files[i].nameLength + 1;
+            connectionCount += loader.files[i].connectionCount;
+            loader.files[roomCount++] = loader.files[i]; //files that were not room files are dropped
+        }
+    }
+    AllocateWorld(world, roomCount, connectionCount, nameBytes);
+
+    //names and types. lines were checked while reading, so every room has both
+    char *value;
+    int valueLength, room;
+    nameBytes = 0;
+    for (room = 0; room < roomCount; room++) {
+        struct RoomFile *file = &loader.files[room];
+        char *line = loader.arenas[file->arena].text + file->offset, *end = line + file->length;
+        int kind;
+        world->nameOffsets[room] = nameBytes;
+        world->types[room] = MID_ROOM;
+        while ((kind = NextRoomLine(&line, end, &value, &valueLength)) != LINE_END) {
+            if (kind == LINE_NAME) {
+                memcpy(world->names + nameBytes, value, valueLength);
+                world->names[nameBytes + valueLength] = '\0';
+            }
+            else if (kind == LINE_TYPE && valueLength == 10 && strncmp(value, "START_ROOM", 10) == 0) {
+                world->types[room] = START_ROOM;
+                world->startRoom = room;
+            }
+            else if (kind == LINE_TYPE && valueLength == 8 && strncmp(value, "END_ROOM", 8) == 0)
+                world->types[room] = END_ROOM;
+        }
+        nameBytes += file->nameLength + 1;
+    }
+    world->nameOffsets[roomCount] = nameBytes;
+
+    //all names are in place, so connections can be looked up in the world's own index.
+    //connections to rooms that don't exist are left out
+    if (IndexWorldNames(world) == -1)
+        printf("Warning! Two rooms have the same name!");
+    connectionCount = 0;
+    for (room = 0; room < roomCount; room++) {
+        struct RoomFile *file = &loader.files[room];
+        char *line = loader.arenas[file->arena].text + file->offset, *end = line + file->length;
+        world->adjacencyOffsets[room] = connectionCount;
+        int kind;
+        while ((kind = NextRoomLine(&line, end, &value, &valueLength)) != LINE_END) {
+            if (kind != LINE_CONNECTION)
+                continue;
+            int neighbor = FindRoom(world, value, valueLength);
+            if (neighbor != -1)
+                world->adjacency[connectionCount++] = neighbor;
+        }
+    }
+    world->adjacencyOffsets[roomCount] = connectionCount;
 
-//given rooms directory, instantiate room structs with name and type
-void InstantiateRoomNamesTypes(char *roomDir, struct Room **rooms) {
-    DIR *d;
-    struct dirent *dir;
-    char filePath[DIRECTORY_PREFIX_CHAR_COUNT+15];
+    for (i = 0; i < MAX_LOAD_THREADS; i++)
+        free(loader.arenas[i].text);
+    free(loader.files);
 
-    //open rooms directory and error check
-    d = opendir(roomDir);
-    if (d == NULL)
-        printf("Warning! Issue with opening current working directory!");
+    if (world->startRoom == -1)
+        printf("Warning! Could not find start room!");
+    return (roomCount > 0) ? 0 : -1;
+}
 
-    //iterates through files and instantiate room name + type
-    int i = 0;
-    while ((dir = readdir(d)) != NULL) {
-        if ((IsHiddenFile(dir->d_name) == 0) && (i < ROOM_COUNT)) { //not a hidden, non-room file
-            //create full dirpath to file
-            memset(filePath, '\0', DIRECTORY_PREFIX_CHAR_COUNT+15);
-            strcpy(filePath, roomDir);
-            strcat(filePath, "/");
-            strcat(filePath, dir->d_name);
-
-            //instantiate room
-            rooms[i] = (struct Room*) malloc(sizeof(struct Room));
-
-            //find name + type
-            char line[50];
-            char lineId[7];
-
-            FILE* file = fopen(filePath, "r");
-            while(fgets(line, sizeof(line), file)) {
-                //get first 6 characters to identify which line is being looked at
-                memset(lineId, '\0', 7);
-                memcpy(lineId, &line[0], 6);
-
-                //based on identifier, correlate and instantiate data
-                if (strcmp(lineId, "ROOM N") == 0) { //ROOM NAME
-                    rooms[i]->name = (char*) malloc(50*sizeof(char));
-                    memset(rooms[i]->name, '\0', 50);
-                    strncpy(rooms[i]->name, line+11, strlen(line)-12);
-                }
-                else if (strcmp(lineId, "ROOM T") == 0) { //ROOM TYPE
-                    rooms[i]->type = (char*) malloc(50*sizeof(char));
-                    memset(rooms[i]->type, '\0', 50);
-                    strncpy(rooms[i]->type, line+11, strlen(line)-12);
-                }
+//lists the files of a directory with getdents64, skipping hidden ones. fileNames is set to a malloc'd array
+//of names that point into the returned pool; free both
+char* ListRoomFiles(int directoryDescriptor, char ***fileNames, int *fileCount) {
+    size_t poolSize = DIRENT_BUFFER_SIZE, poolUsed = 0;
+    char *pool = (char*) malloc(poolSize);
+    size_t *offsets = (size_t*) malloc(MIN_ROOMS_SIZE * sizeof(size_t));
+    int offsetsSize = MIN_ROOMS_SIZE, count = 0;
+    char *buffer = (char*) malloc(DIRENT_BUFFER_SIZE);
+
+    //struct linux_dirent64 has no glibc declaration; only the fields used here are read
+    long bytes;
+    while ((bytes = syscall(SYS_getdents64, directoryDescriptor, buffer, DIRENT_BUFFER_SIZE)) > 0) {
+        long position = 0;
+        while (position < bytes) {
+            unsigned short recordLength;
+            memcpy(&recordLength, buffer + position + 16, sizeof(recordLength)); //after d_ino and d_off
+            unsigned char fileType = buffer[position + 18];
+            char *fileName = buffer + position + 19;
+            position += recordLength;
+
+            if (IsHiddenFile(fileName) || (fileType != DT_REG && fileType != DT_UNKNOWN))
+                continue; //not a room file
+
+            size_t length = strlen(fileName) + 1;
+            if (poolUsed + length > poolSize) {
+                poolSize *= 2;
+                pool = (char*) realloc(pool, poolSize);
             }
-            fclose(file);
-
-            i++; //increments for next room struct in array
+            if (count == offsetsSize) {
+                offsetsSize *= 2;
+                offsets = (size_t*) realloc(offsets, offsetsSize * sizeof(size_t));
+            }
+            memcpy(pool + poolUsed, fileName, length);
+            offsets[count++] = poolUsed;
+            poolUsed += length;
         }
     }
-    closedir(d);
-}
+    if (bytes == -1)
+        printf("Warning! Issue with reading rooms directory!");
+    free(buffer);
 
-//given room file, fill in necessary data for struct Room
-void InstantiateRoomConnections(char *roomDir, struct Room **rooms) {
-    DIR *d;
-    struct dirent *dir;
-    char filePath[DIRECTORY_PREFIX_CHAR_COUNT+15];
+    //the pool is done moving, so the offsets can become pointers now
+    *fileNames = (char**) malloc((count + 1) * sizeof(char*));
+    int i;
+    for (i = 0; i < count; i++)
+        (*fileNames)[i] = pool + offsets[i];
+    free(offsets);
+    *fileCount = count;
+    return pool;
+}
 
-    //open rooms directory and error check
-    d = opendir(roomDir);
-    if (d == NULL)
-        printf("Warning! Issue with opening current working directory!");
+//thread body: reads files of the loader into a text arena of its own until none are left
+void* LoadRoomFiles(void *argument) {
+    struct RoomLoader *loader = (struct RoomLoader*) argument;
+    pthread_mutex_lock(&loader->nextLock);
+    int arena = loader->nextArena++;
+    pthread_mutex_unlock(&loader->nextLock);
 
-    //iterates through files, match file with correct room struct, and instantiate connections
-    int i = 0;
-    while ((dir = readdir(d)) != NULL) {
-        if ((IsHiddenFile(dir->d_name) == 0) && (i < ROOM_COUNT)) { //not a hidden, non-room file
-            //create full dirpath to file
-            memset(filePath, '\0', DIRECTORY_PREFIX_CHAR_COUNT+15);
-            strcpy(filePath, roomDir);
-            strcat(filePath, "/");
-            strcat(filePath, dir->d_name);
-
-            //match file name with room
-            int j;
-            for (j = 0; j < ROOM_COUNT; j++) {
-                if (strcmp(dir->d_name, rooms[j]->name) == 0)
-                    break; //j holds correct index for room struct
-            }
+    while (1) {
+        pthread_mutex_lock(&loader->nextLock);
+        int first = loader->nextFile;
+        loader->nextFile += LOAD_CHUNK;
+        pthread_mutex_unlock(&loader->nextLock);
+        if (first >= loader->fileCount)
+            return NULL;
 
-            //setup room
-            rooms[j]->connectionCount = 0;
-            rooms[j]->connection = (struct Room **) malloc(MAX_CONNECTIONS*sizeof(struct Room*));
-
-            //make connections
-            char line[50];
-            char lineId[7];
-            char lineData[50];
-
-            FILE* file = fopen(filePath, "r");
-            while(fgets(line, sizeof(line), file)) {
-                //get first 6 characters to identify which line is being looked at
-                memset(lineId, '\0', 7);
-                memcpy(lineId, &line[0], 6);
-
-                //based on identifier, correlate and instantiate data
-                if (strcmp(lineId, "CONNEC") == 0) {
-                    memset(lineData, '\0', 50);
-                    strncpy(lineData, line+14, strlen(line)-15);
-
-                    //find the correct room with matching name of connection, and add it to connection array
-                    int k;
-                    for (k = 0; k < ROOM_COUNT; k++) {
-                        if (strcmp(rooms[k]->name, lineData) == 0) {
-                            rooms[j]->connection[rooms[j]->connectionCount] = rooms[k];
-                            rooms[j]->connectionCount++;
-                            break;
-                        }
-                    }
-                }
+        int i;
+        for (i = first; i < first + LOAD_CHUNK && i < loader->fileCount; i++) {
+            struct RoomFile *file = &loader->files[i];
+            if (ReadRoomFile(loader->directoryDescriptor, loader->fileNames[i], &loader->arenas[arena], file) == 0)
+                file->arena = arena;
+            else {
+                file->arena = -1;
+                printf("Warning! %s is not a room file!\n", loader->fileNames[i]);
             }
-            fclose(file);
+        }
+    }
+}
 
-            i++; //acts as a protection in case bad directory has additional files
+//reads one room file (opened relative to the rooms directory) onto the end of arena and counts what the world
+//will need for it. returns -1, leaving the arena as it was, if the file can't be read or has no name or type
+int ReadRoomFile(int directoryDescriptor, char *fileName, struct TextArena *arena, struct RoomFile *file) {
+    int fileDescriptor = openat(directoryDescriptor, fileName, O_RDONLY);
+    if (fileDescriptor == -1)
+        return -1;
+
+    size_t length = 0;
+    ssize_t count;
+    do {
+        if (arena->size - arena->used - length < ROOM_FILE_MIN_SIZE) {
+            arena->size = (arena->size == 0) ? ROOM_FILE_MIN_SIZE * LOAD_CHUNK : arena->size * 2;
+            arena->text = (char*) realloc(arena->text, arena->size);
+        }
+        count = read(fileDescriptor, arena->text + arena->used + length, arena->size - arena->used - length);
+        if (count > 0)
+            length += count;
+    } while (count > 0);
+    close(fileDescriptor);
+
+    //pick the lines apart by what they start with
+    char *line = arena->text + arena->used, *end = line + length, *value;
+    int kind, valueLength, hasName = 0, hasType = 0;
+    file->nameLength = 0;
+    file->connectionCount = 0;
+    while ((kind = NextRoomLine(&line, end, &value, &valueLength)) != LINE_END) {
+        if (kind == LINE_NAME) {
+            hasName = (valueLength > 0);
+            file->nameLength = valueLength;
         }
+        else if (kind == LINE_TYPE)
+            hasType = 1;
+        else if (kind == LINE_CONNECTION)
+            file->connectionCount++;
     }
-    closedir(d);
+
+    if (count == -1 || !hasName || !hasType)
+        return -1;
+    file->offset = arena->used;
+    file->length = length;
+    arena->used += length;
+    return 0;
+}
+
+//returns the kind of the room file line at cursor, with value and valueLength set to what comes after ": ",
+//and moves cursor to the next line. LINE_END once cursor reaches end
+int NextRoomLine(char **cursor, char *end, char **value, int *valueLength) {
+    if (*cursor >= end)
+        return LINE_END;
+    char *line = *cursor;
+    char *lineEnd = (char*) memchr(line, '\n', end - line);
+    if (lineEnd == NULL)
+        lineEnd = end;
+    *cursor = (lineEnd < end) ? lineEnd + 1 : end;
+
+    char *separator = (char*) memmem(line, lineEnd - line, ": ", 2);
+    if (separator == NULL)
+        return LINE_OTHER;
+    *value = separator + 2;
+    *valueLength = lineEnd - *value;
+
+    int keyLength = separator - line;
+    if (keyLength == 9 && strncmp(line, "ROOM NAME", 9) == 0)
+        return LINE_NAME;
+    if (keyLength == 9 && strncmp(line, "ROOM TYPE", 9) == 0)
+        return LINE_TYPE;
+    if (keyLength >= 10 && strncmp(line, "CONNECTION", 10) == 0)
+        return LINE_CONNECTION;
+    return LINE_OTHER;
 }
 
 //checks whether passed in file name begins w/ ".". If it does, then likely autogenerated hidden file
@@ -270,222 +550,1171 @@ int IsHiddenFile(char* fileName) {
         return 0;
 }
 
-//free all allocated memory, namely for structures and connections
-void FreeMemory(struct Room **rooms) {
+//arena blocks are rounded up to 8 bytes, so every block is aligned for any of the world's arrays
+#define ARENA_BYTES(bytes) (((size_t) (bytes) + 7) & ~(size_t) 7)
+
+//returns the next block of bytes from the arena at next, and moves next past it
+void* ArenaTake(char **next, size_t bytes) {
+    void *block = *next;
+    *next += ARENA_BYTES(bytes);
+    return block;
+}
+
+//allocates the world's arena: the name index and next hops, and when the world is not mapped from a file, its
+//names, types and connections as well. startRoom and shortestSteps start out unknown
+void AllocateWorld(struct World *world, int roomCount, size_t connectionCount, size_t nameBytes) {
+    int isMapped = (world->mapping != NULL);
+    world->roomCount = roomCount;
+    world->startRoom = -1;
+    world->shortestSteps = -1;
+    world->nameSlotCount = 16;
+    while (world->nameSlotCount < 2 * (uint32_t) roomCount)
+        world->nameSlotCount *= 2;
+
+    size_t size = ARENA_BYTES(world->nameSlotCount * sizeof(uint32_t)) + ARENA_BYTES(roomCount * sizeof(int32_t));
+    if (!isMapped)
+        size += 2 * ARENA_BYTES((roomCount + 1) * sizeof(uint32_t)) + ARENA_BYTES(connectionCount * sizeof(uint32_t)) +
+                ARENA_BYTES(roomCount) + ARENA_BYTES(nameBytes);
+    world->arena = (char*) malloc(size);
+
+    char *next = world->arena;
+    world->nameSlots = (uint32_t*) ArenaTake(&next, world->nameSlotCount * sizeof(uint32_t));
+    world->nextHop = (int32_t*) ArenaTake(&next, roomCount * sizeof(int32_t));
+    if (!isMapped) {
+        world->mappingSize = 0;
+        world->nameOffsets = (uint32_t*) ArenaTake(&next, (roomCount + 1) * sizeof(uint32_t));
+        world->adjacencyOffsets = (uint32_t*) ArenaTake(&next, (roomCount + 1) * sizeof(uint32_t));
+        world->adjacency = (uint32_t*) ArenaTake(&next, connectionCount * sizeof(uint32_t));
+        world->types = (uint8_t*) ArenaTake(&next, roomCount);
+        world->names = (char*) ArenaTake(&next, nameBytes);
+    }
+}
+
+//returns the name index slot of the room called name (length bytes, need not end in NUL), or the empty slot
+//where that room would go
+uint32_t* NameSlot(struct World *world, char *name, int length) {
+    unsigned int hash = 2166136261u;
     int i;
-    for (i = 0; i < ROOM_COUNT; i++) {
-        free(rooms[i]->connection);
-        free(rooms[i]->name);
-        free(rooms[i]->type);
-        free(rooms[i]);
+    for (i = 0; i < length; i++)
+        hash = (hash ^ (unsigned char) name[i]) * 16777619u;
+
+    uint32_t slot = hash & (world->nameSlotCount - 1);
+    while (world->nameSlots[slot] != 0) {
+        char *slotName = RoomName(world, world->nameSlots[slot] - 1);
+        if (strncmp(slotName, name, length) == 0 && slotName[length] == '\0')
+            break;
+        slot = (slot + 1) & (world->nameSlotCount - 1);
     }
+    return &world->nameSlots[slot];
+}
 
-    free(rooms);
+//returns the number of the room with this name, -1 if there is none
+int FindRoom(struct World *world, char *name, int length) {
+    return (int) *NameSlot(world, name, length) - 1;
+}
+
+//indexes all room names of the world. returns -1 if two rooms share a name, as moves to it would be ambiguous;
+//the first room with the name is the one found then
+int IndexWorldNames(struct World *world) {
+    memset(world->nameSlots, 0, world->nameSlotCount * sizeof(uint32_t));
+    int i, result = 0;
+    for (i = 0; i < world->roomCount; i++) {
+        uint32_t *slot = NameSlot(world, RoomName(world, i), strlen(RoomName(world, i)));
+        if (*slot != 0)
+            result = -1;
+        else
+            *slot = i + 1;
+    }
+    return result;
+}
+
+//maps the directory's world file and checks it in one pass over rooms and connections, so a broken or foreign
+//file can't send the game out of bounds. returns 0 when world is ready to use, -1 if there is no usable world file
+int LoadWorldFile(char *roomDir, struct World *world) {
+    char *filePath = (char*) malloc(strlen(roomDir) + sizeof(WORLD_FILE) + 1);
+    sprintf(filePath, "%s/%s", roomDir, WORLD_FILE);
+    int fileDescriptor = open(filePath, O_RDONLY);
+    free(filePath);
+    if (fileDescriptor == -1)
+        return -1; //no world file, e.g. rooms made by an older gel.buildrooms
+
+    struct stat fileStat;
+    void *mapping = MAP_FAILED;
+    if (fstat(fileDescriptor, &fileStat) == 0 && fileStat.st_size >= (off_t) sizeof(struct WorldHeader))
+        mapping = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+    close(fileDescriptor);
+    if (mapping == MAP_FAILED) {
+        printf("Warning! World file could not be mapped, reading the room files instead.\n");
+        return -1;
+    }
+
+    //header and section sizes. the counts are 32 bit, so none of this overflows a 64 bit size_t
+    struct WorldHeader *header = (struct WorldHeader*) mapping;
+    size_t roomCount = header->roomCount, connectionCount = header->connectionCount;
+    size_t expectedSize = sizeof(struct WorldHeader) + 2*(roomCount + 1)*sizeof(uint32_t) +
+                          connectionCount*sizeof(uint32_t) + roomCount + header->nameBytes;
+    int isValid = memcmp(header->magic, WORLD_MAGIC, 4) == 0 && header->version == WORLD_VERSION &&
+                  roomCount >= 2 && roomCount <= INT32_MAX && (size_t) fileStat.st_size == expectedSize;
+
+    if (isValid) {
+        world->mapping = mapping;
+        world->mappingSize = fileStat.st_size;
+        AllocateWorld(world, roomCount, 0, 0);
+        world->nameOffsets = (uint32_t*) (header + 1);
+        world->adjacencyOffsets = world->nameOffsets + roomCount + 1;
+        world->adjacency = world->adjacencyOffsets + roomCount + 1;
+        world->types = (uint8_t*) (world->adjacency + connectionCount);
+        world->names = (char*) (world->types + roomCount);
+
+        //offsets start at 0, never go backwards and end at the section size; every name is non-empty and ends in NUL
+        isValid = world->nameOffsets[0] == 0 && world->nameOffsets[roomCount] == header->nameBytes &&
+                  world->adjacencyOffsets[0] == 0 && world->adjacencyOffsets[roomCount] == connectionCount;
+        int startCount = 0, endCount = 0;
+        size_t i;
+        for (i = 0; i < roomCount && isValid; i++) {
+            uint32_t nameStart = world->nameOffsets[i], nameEnd = world->nameOffsets[i+1];
+            if (nameEnd < nameStart + 2 || nameEnd > header->nameBytes || world->names[nameEnd-1] != '\0' ||
+                world->adjacencyOffsets[i+1] < world->adjacencyOffsets[i] || world->types[i] > END_ROOM)
+                isValid = 0;
+            if (world->types[i] == START_ROOM) {
+                startCount++;
+                world->startRoom = i;
+            }
+            endCount += (world->types[i] == END_ROOM);
+        }
+        for (i = 0; i < connectionCount && isValid; i++) {
+            if (world->adjacency[i] >= roomCount)
+                isValid = 0;
+        }
+        isValid = isValid && startCount == 1 && endCount == 1 && IndexWorldNames(world) == 0;
+        if (!isValid) {
+            free(world->arena);
+            world->arena = NULL;
+            world->mapping = NULL;
+            world->startRoom = -1;
+        }
+    }
+
+    if (!isValid) {
+        printf("Warning! World file is damaged, reading the room files instead.\n");
+        munmap(mapping, fileStat.st_size);
+        return -1;
+    }
+    return 0;
+}
+
+//loads the world of a rooms directory: the world file when there is a good one, else the text room files.
+//if neither can be read, world has no start room (-1) and nothing for FreeWorld() to free
+void LoadWorld(char *roomDir, struct World *world) {
+    memset(world, 0, sizeof(struct World));
+    world->startRoom = -1;
+    world->shortestSteps = -1;
+    if (LoadWorldFile(roomDir, world) == 0)
+        return;
+
+    FillRoomsData(roomDir, world);
+}
+
+//frees the world's arena and unmaps its file
+void FreeWorld(struct World *world) {
+    free(world->arena);
+    if (world->mapping != NULL)
+        munmap(world->mapping, world->mappingSize);
 }
 
 
 ////D. Functions For Game & UI -------------------------------------------------------------
 //function prototypes to prevent implicit declaration issues
-int BeginGame(struct Room**);
-int IdentifyStartRoom(struct Room**);
-int IsEndRoom(struct Room *);
-struct Room* UserQuery(struct Room**, struct Room*);
-void DispEnd(int, struct Node *);
-void FreeNodeMemory(struct Node *);
-void recordTime();
-void displayTime();
+void BeginGame(struct World *);
+int IsEndRoom(struct World *, int);
+int UserQuery(struct World *, int);
+void BufferAdd(struct Buffer *, char *, size_t);
+void BufferAddString(struct Buffer *, char *);
+void AddPrompt(struct Buffer *, struct World *, int);
+int ApplyInput(struct Buffer *, struct World *, int, char *);
+int AddInput(char *, int *, char);
+char* EndScreen(struct World *, struct Path *, size_t *);
+void DispEnd(struct World *, struct Path *);
+void AddToPath(struct Path *, uint32_t);
+char* PathText(struct World *, struct Path *, char *, char *, size_t *);
+int WriteAll(int, char *, size_t);
+int RecordPath(struct World *, struct Path *, char *);
+int ReplayPath(struct World *, struct Path *, char *);
+int BatchPath(struct World *, struct Path *, char *);
+double Seconds();
+void StartTimeService();
+void* RunTimeService(void *);
+void RequestTime(char *);
+void StopTimeService();
 
 //primary interface for player interaction. utilizes several helper functions to pull data
-int BeginGame(struct Room** rooms) {
-    //setup for starting room, step tracker, and also head node of linked list for path tracking
-    int startIndex = IdentifyStartRoom(rooms);
-    struct Room* currentLocation = rooms[startIndex];
-    int roomTracker = 0;
-    struct Node *head = (struct Node*) malloc(sizeof(struct Node));
-    head->room = currentLocation;
-    head->next = NULL;
-    struct Node *trackPointer = head;
+void BeginGame(struct World *world) {
+    //setup for starting room and the path, which holds the steps taken so far
+    int currentLocation = world->startRoom;
+    struct Path path = {NULL, 0, 0};
+    AddToPath(&path, currentLocation);
+
+    //primary loop of user interaction and movement. a replayed game is all read from its file instead
+    if (replayFile != NULL) {
+        if (ReplayPath(world, &path, replayFile) == -1)
+            exit(1);
+    }
+    if (batchFile != NULL && BatchPath(world, &path, batchFile) == -1)
+        exit(1);
+    while(!IsEndRoom(world, path.rooms[path.count-1]))
+        AddToPath(&path, UserQuery(world, path.rooms[path.count-1]));
+
+    //display results, and keep the path if asked to
+    DispEnd(world, &path);
+    if (recordFile != NULL && RecordPath(world, &path, recordFile) == -1)
+        fprintf(stderr, "Warning! Could not record the path to %s.\n", recordFile);
+
+    free(path.rooms);
+}
+
+//displays end results: message, steps, and path. written out in one go, as paths of automated games can be long
+void DispEnd(struct World *world, struct Path *path) {
+    size_t length;
+    char *text = EndScreen(world, path, &length);
+    fflush(stdout); //everything printed before goes first
+    WriteAll(STDOUT_FILENO, text, length);
+    free(text);
+}
+
+//returns the malloc'd text of the end results, with length set to its length
+char* EndScreen(struct World *world, struct Path *path, size_t *length) {
+    char header[128], footer[64] = "";
+    snprintf(header, sizeof(header), "YOU HAVE FOUND THE END ROOM. CONGRATULATIONS!\n"
+                                     "YOU TOOK %zu STEPS. YOUR PATH TO VICTORY WAS:\n", path->count - 1);
+    //no shortest path is known (-1) when the solver found no way from the start room, as with a one-way
+    //connection in hand-made room files
+    if (world->shortestSteps >= 0)
+        snprintf(footer, sizeof(footer), "THE SHORTEST PATH TAKES %d STEPS.\n", world->shortestSteps);
+    return PathText(world, path, header, footer, length);
+}
 
-    //primary loop of user interaction and movement
-    while(!IsEndRoom(currentLocation)) {
-        currentLocation = UserQuery(rooms, currentLocation);
+//adds a room to the end of the path
+void AddToPath(struct Path *path, uint32_t room) {
+    if (path->count == path->size) {
+        path->size = (path->size == 0) ? MIN_PATH_SIZE : path->size * 2;
+        path->rooms = (uint32_t*) realloc(path->rooms, path->size * sizeof(uint32_t));
+    }
+    path->rooms[path->count++] = room;
+}
 
-        //tracking data with a classic linked list!
-        roomTracker++;
-        trackPointer->next = (struct Node*) malloc(sizeof(struct Node));
-        trackPointer = trackPointer->next;
-        trackPointer->room = currentLocation;
-        trackPointer->next = NULL;
+//returns a malloc'd text of header, the name of every room on the path after the start room on its own line,
+//then footer. length is set to its length
+char* PathText(struct World *world, struct Path *path, char *header, char *footer, size_t *length) {
+    size_t headerLength = strlen(header), footerLength = strlen(footer), size = headerLength + footerLength;
+    size_t i;
+    for (i = 1; i < path->count; i++)
+        size += strlen(RoomName(world, path->rooms[i])) + 1;
+
+    char *text = (char*) malloc(size + 1);
+    memcpy(text, header, headerLength);
+    char *next = text + headerLength;
+    for (i = 1; i < path->count; i++) {
+        char *name = RoomName(world, path->rooms[i]);
+        size_t nameLength = strlen(name);
+        memcpy(next, name, nameLength);
+        next[nameLength] = '\n';
+        next += nameLength + 1;
     }
+    memcpy(next, footer, footerLength + 1);
+    *length = size;
+    return text;
+}
 
-    //display results. make sure to pass head->next as first room doesn't get listed
-    DispEnd(roomTracker, head->next);
+//write() until everything is out. returns 0 on success, -1 on error
+int WriteAll(int fileDescriptor, char *buffer, size_t length) {
+    size_t written = 0;
+    while (written < length) {
+        ssize_t count = write(fileDescriptor, buffer + written, length - written);
+        if (count <= 0)
+            return -1;
+        written += count;
+    }
+    return 0;
+}
 
-    //free up nodes used for path tracking
-    FreeNodeMemory(head);
+//writes the path to a file that --replay can play back:
+//  gel.path 1
+//  rooms <number of rooms in the world>
+//  start <start room>
+//then one room name per line for every step. returns -1 if the file can't be written
+int RecordPath(struct World *world, struct Path *path, char *fileName) {
+    //sized for the start room's name, which can be any length in a world read from text files
+    char *startName = RoomName(world, path->rooms[0]);
+    size_t headerSize = sizeof(PATH_MAGIC) + strlen(startName) + 64;
+    char *header = (char*) malloc(headerSize);
+    snprintf(header, headerSize, PATH_MAGIC"\nrooms %d\nstart %s\n", world->roomCount, startName);
+
+    size_t length;
+    char *text = PathText(world, path, header, "", &length);
+    free(header);
+    int fileDescriptor = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int result = (fileDescriptor == -1 || WriteAll(fileDescriptor, text, length) == -1) ? -1 : 0;
+    if (fileDescriptor != -1 && close(fileDescriptor) == -1)
+        result = -1;
+    free(text);
+    return result;
 }
 
-//displays end results: message, steps, and path
-void DispEnd(int steps, struct Node *tracker) {
-    printf("YOU HAVE FOUND THE END ROOM. CONGRATULATIONS!\n");
-    printf("YOU TOOK %d STEPS. YOUR PATH TO VICTORY WAS:\n", steps);
-    while (tracker != NULL) {
-        printf("%s\n", tracker->room->name);
-        tracker = tracker->next;
+//plays back a path written by RecordPath(), adding its steps to path. every step has to be a connection of the
+//room before, so a path only replays on the world it was made in (or one with the same rooms and connections).
+//returns -1, after saying what is wrong, if the file can't be read or doesn't fit the world
+int ReplayPath(struct World *world, struct Path *path, char *fileName) {
+    int fileDescriptor = open(fileName, O_RDONLY);
+    struct stat fileStat;
+    if (fileDescriptor == -1 || fstat(fileDescriptor, &fileStat) == -1) {
+        fprintf(stderr, "Cannot read path file %s.\n", fileName);
+        if (fileDescriptor != -1)
+            close(fileDescriptor);
+        return -1;
+    }
+
+    //whole file at once
+    char *text = (char*) malloc(fileStat.st_size + 1);
+    size_t length = 0;
+    ssize_t count;
+    while (length < (size_t) fileStat.st_size && (count = read(fileDescriptor, text + length, fileStat.st_size - length)) > 0)
+        length += count;
+    close(fileDescriptor);
+    text[length] = '\0';
+
+    char *line = text, *end = text + length, *lineEnd;
+    int lineNumber = 0, result = 0;
+    char expected[64];
+    for (; line < end && result == 0; line = lineEnd + 1) {
+        lineEnd = (char*) memchr(line, '\n', end - line);
+        if (lineEnd == NULL)
+            lineEnd = end;
+        *lineEnd = '\0';
+        lineNumber++;
+
+        //three header lines, then the steps
+        if (lineNumber == 1)
+            result = (strcmp(line, PATH_MAGIC) == 0) ? 0 : -1;
+        else if (lineNumber == 2) {
+            snprintf(expected, sizeof(expected), "rooms %d", world->roomCount);
+            result = (strcmp(line, expected) == 0) ? 0 : -1;
+        }
+        else if (lineNumber == 3)
+            result = (strncmp(line, "start ", 6) == 0 && strcmp(line + 6, RoomName(world, path->rooms[0])) == 0) ? 0 : -1;
+        else if (*line != '\0') {
+            uint32_t current = path->rooms[path->count-1];
+            int room = FindRoom(world, line, lineEnd - line);
+            uint32_t i;
+            for (i = world->adjacencyOffsets[current]; i < world->adjacencyOffsets[current+1]; i++) {
+                if (world->adjacency[i] == (uint32_t) room)
+                    break;
+            }
+            if (room == -1 || i == world->adjacencyOffsets[current+1] || IsEndRoom(world, current))
+                result = -1;
+            else
+                AddToPath(path, room);
+        }
     }
+    if (lineNumber < 3)
+        result = -1;
+    if (result == -1)
+        fprintf(stderr, "Path file %s doesn't fit this world (line %d).\n", fileName, lineNumber);
+
+    free(text);
+    return result;
 }
 
-//frees linked list used for path tracking
-void FreeNodeMemory(struct Node *head) {
-    struct Node *pointer = head->next;
+//plays the moves in fileName ("-" for stdin), adding the steps to path. the moves are read a big chunk at a time
+//and the game's answers are piled up and written in big pieces, or dropped with --quiet, so a scripted game isn't
+//held up by a read and a write per move. stops at the end room or when the moves run out, then reports the moves
+//per second and load time on stderr. returns -1 if the file can't be read
+int BatchPath(struct World *world, struct Path *path, char *fileName) {
+    int fileDescriptor = (strcmp(fileName, "-") == 0) ? STDIN_FILENO : open(fileName, O_RDONLY);
+    if (fileDescriptor == -1) {
+        fprintf(stderr, "Cannot read moves file %s.\n", fileName);
+        return -1;
+    }
 
-    while (head != NULL) {
-        free(head);
-        head = pointer;
-        if (head == NULL) { //for last, so pointer is not trying to reassign null->next
-            free(head);
-            head = NULL;
+    char *data = (char*) malloc(BATCH_READ_SIZE);
+    char input[INPUT_SIZE];
+    int inputLength = 0, isDone = 0;
+    int room = path->rooms[path->count-1];
+    size_t moves = 0;
+    double start = Seconds();
+    fflush(stdout); //everything printed before goes first
+    screen.length = 0;
+
+    while (!isDone && !IsEndRoom(world, room)) {
+        ssize_t count = read(fileDescriptor, data, BATCH_READ_SIZE), i;
+        if (count == -1 && errno == EINTR)
+            continue;
+        if (count <= 0) {
+            //a last word without a newline after it still counts
+            data[0] = '\n';
+            count = 1;
+            isDone = 1;
+        }
+
+        for (i = 0; i < count && !IsEndRoom(world, room); i++) {
+            if (!AddInput(input, &inputLength, data[i]))
+                continue;
+
+            moves++;
+            if (!isQuiet)
+                AddPrompt(&screen, world, room);
+            int next = ApplyInput(&screen, world, room, input);
+            if (next != -1) {
+                AddToPath(path, next);
+                room = next;
+            }
+            if (isQuiet)
+                screen.length = 0;
+            else if (screen.length >= BATCH_OUTPUT_SIZE) {
+                WriteAll(STDOUT_FILENO, screen.text, screen.length);
+                screen.length = 0;
+            }
         }
-        else
-            pointer = head->next;
     }
+    WriteAll(STDOUT_FILENO, screen.text, screen.length);
+    screen.length = 0;
+
+    double seconds = Seconds() - start;
+    fprintf(stderr, "batch: %d rooms loaded in %.3f s, solved in %.3f s; %zu moves in %.3f s, %.0f moves/s\n",
+            world->roomCount, loadSeconds, solveSeconds, moves, seconds, moves / (seconds > 0 ? seconds : 1e-9));
+    if (fileDescriptor != STDIN_FILENO)
+        close(fileDescriptor);
+    free(data);
+    return 0;
+}
+
+//monotonic clock in seconds
+double Seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
 }
 
 //handles logic for displaying primary interface and redirect of bad responses
-struct Room* UserQuery(struct Room** rooms, struct Room* currentLocation) {
+int UserQuery(struct World *world, int currentLocation) {
     //begin looping for user I/O
     while (1) {
         //display information based on current location
-        printf("CURRENT LOCATION: %s\n", currentLocation->name);
-        printf("POSSIBLE CONNECTIONS: ");
-        int i;
-        for (i = 0; i < currentLocation->connectionCount-1; i++)
-            printf("%s, ", currentLocation->connection[i]->name);
-        printf("%s.\n", currentLocation->connection[i]->name);
-        printf("WHERE TO? >");
-
-        //user query
-        char userInput[256];
-        memset(userInput, '\0', 256);
-        scanf(" %s", userInput);
-
-        //process input if matches
-        for (i = 0; i < currentLocation->connectionCount; i++) {
-            if (strcmp(userInput, currentLocation->connection[i]->name) == 0) {
-                currentLocation = currentLocation->connection[i];
-                printf("\n");
-                return currentLocation;
+        screen.length = 0;
+        AddPrompt(&screen, world, currentLocation);
+        fwrite(screen.text, 1, screen.length, stdout);
+
+        //user query. no more input means the player is gone. autoplay answers with the solver's next hop
+        char userInput[INPUT_SIZE];
+        memset(userInput, '\0', INPUT_SIZE);
+        if (isAutoplay) {
+            if (world->nextHop[currentLocation] == -1) {
+                printf("\nTHE END ROOM CAN'T BE REACHED FROM HERE.\n");
+                exit(1);
             }
+            snprintf(userInput, sizeof(userInput), "%s", RoomName(world, world->nextHop[currentLocation]));
+            printf("%s\n", userInput);
+        }
+        else if (scanf(" %255s", userInput) != 1) {
+            printf("\n");
+            exit(0);
         }
 
-        if(strcmp(userInput, "time") == 0) {
+        screen.length = 0;
+        int room = ApplyInput(&screen, world, currentLocation, userInput);
+        fwrite(screen.text, 1, screen.length, stdout);
+        if (room != -1)
+            return room;
+    }
+}
 
-            //main threads lets go of lock, passing it to time thread
-            pthread_mutex_unlock(&lock);
+//adds one character a player typed to the word being read. returns 1 when input holds a whole word to play:
+//whitespace ended it, or it reached INPUT_SIZE - 1 characters and the rest becomes the next word, the way
+//scanf("%255s") reads long words in UserQuery(). --batch and --serve read through this, so they agree with it
+int AddInput(char *input, int *inputLength, char c) {
+    if (!isspace((unsigned char) c)) {
+        input[(*inputLength)++] = c;
+        if (*inputLength < INPUT_SIZE - 1)
+            return 0;
+    }
+    else if (*inputLength == 0)
+        return 0;
+    input[*inputLength] = '\0';
+    *inputLength = 0;
+    return 1;
+}
 
-            //after unlock, time thread able to run this:
-            recordTime();
+//adds text to the end of the buffer
+void BufferAdd(struct Buffer *buffer, char *text, size_t length) {
+    if (buffer->length + length > buffer->size) {
+        if (buffer->size == 0)
+            buffer->size = MIN_BUFFER_SIZE;
+        while (buffer->length + length > buffer->size)
+            buffer->size *= 2;
+        buffer->text = (char*) realloc(buffer->text, buffer->size);
+    }
+    memcpy(buffer->text + buffer->length, text, length);
+    buffer->length += length;
+}
+
+void BufferAddString(struct Buffer *buffer, char *text) {
+    BufferAdd(buffer, text, strlen(text));
+}
 
-            //time thread is destroyed at end of recordTime(), so main thread runs
-            displayTime();
+//adds the prompt for a player in room: where they are, where they can go and the question
+void AddPrompt(struct Buffer *buffer, struct World *world, int room) {
+    BufferAddString(buffer, "CURRENT LOCATION: ");
+    BufferAddString(buffer, RoomName(world, room));
+    BufferAddString(buffer, "\nPOSSIBLE CONNECTIONS: ");
+    uint32_t i;
+    for (i = world->adjacencyOffsets[room]; i < world->adjacencyOffsets[room+1]; i++) {
+        BufferAddString(buffer, RoomName(world, world->adjacency[i]));
+        BufferAddString(buffer, (i < world->adjacencyOffsets[room+1] - 1) ? ", " : ".");
+    }
+    BufferAddString(buffer, "\nWHERE TO? >");
+}
 
-            //main thread picks up lock again and recreates time thread within this loop
-            pthread_mutex_lock(&lock);
+//acts on what a player in room typed, adding the answer to buffer. returns the room moved to, or -1 if the
+//player stays (a hint, the time, or input that isn't a connected room)
+int ApplyInput(struct Buffer *buffer, struct World *world, int room, char *input) {
+    //process input if it names a room connected to this one
+    int next = FindRoom(world, input, strlen(input));
+    uint32_t i;
+    for (i = world->adjacencyOffsets[room]; i < world->adjacencyOffsets[room+1] && next != -1; i++) {
+        if (world->adjacency[i] == (uint32_t) next) {
+            BufferAddString(buffer, "\n");
+            return next;
+        }
+    }
 
-            //recreate time thread, which is idling until recordTime() is called after this loop
-            int resultInt1;
-            pthread_t threadId1;
-            resultInt1 = pthread_create(&threadId1, NULL, (void*) recordTime, NULL);
-            if (resultInt1 != 0)
-                printf("Warning! Error creating thread #1 for recording time.");
+    if (strcmp(input, "hint") == 0) {
+        if (world->nextHop[room] == -1)
+            BufferAddString(buffer, "\nTHE END ROOM CAN'T BE REACHED FROM HERE.\n\n");
+        else {
+            BufferAddString(buffer, "\nHINT: GO TO ");
+            BufferAddString(buffer, RoomName(world, world->nextHop[room]));
+            BufferAddString(buffer, ".\n\n");
         }
-        else //if input reaches here, means not a valid input
-            printf("\nHUH? I DON’T UNDERSTAND THAT ROOM. TRY AGAIN.\n\n");
     }
+    else if(strcmp(input, "time") == 0) {
+        //the time thread answers right away and writes currentTime.txt afterwards
+        char output[TIME_SIZE];
+        RequestTime(output);
+        BufferAddString(buffer, "\n");
+        BufferAddString(buffer, output);
+        BufferAddString(buffer, "\n\n");
+    }
+    else //if input reaches here, means not a valid input
+        BufferAddString(buffer, "\nHUH? I DON’T UNDERSTAND THAT ROOM. TRY AGAIN.\n\n");
+    return -1;
 }
 
-//main thread retrieves the time afterwards
-void displayTime() {
-    char output[100];
-    memset(output, '\0', 100);
+//starts the time thread. without it, the game thread formats the time itself
+void StartTimeService() {
+    if (pthread_create(&timeService.thread, NULL, RunTimeService, NULL) != 0) {
+        printf("Warning! Error creating thread for recording time.");
+        return;
+    }
+    timeService.isRunning = 1;
+    atexit(StopTimeService); //the game can end with exit() anywhere; a started file write still gets finished
+}
 
-    FILE* file = fopen(TIME_FILE, "r");
-    fgets(output, sizeof(output), file);
-    fclose(file);
+//time thread: answers requests until stopped
+void* RunTimeService(void *argument) {
+    pthread_mutex_lock(&timeService.lock);
+    while (1) {
+        while (!timeService.isRequested && !timeService.isStopping)
+            pthread_cond_wait(&timeService.changed, &timeService.lock);
+        if (timeService.isStopping)
+            break;
+
+        //create string for time format, 1:03pm, Tuesday, September 13, 2016
+        time_t t = time(NULL);
+        struct tm tmp;
+        localtime_r(&t, &tmp);
+        if (strftime(timeService.output, TIME_SIZE, "%l:%M%P, %A, %B %d, %Y", &tmp) == 0)
+            printf("Warning! Error with recording time in correct format with strftime.");
+        timeService.isRequested = 0;
+        timeService.isAnswered = 1;
+        pthread_cond_broadcast(&timeService.changed);
+
+        //write time to the file with the lock let go, so the game can go on meanwhile. a request that came in
+        //since is answered first; its own answer writes the newer time
+        if (timeService.isWritingFile && !timeService.isRequested) {
+            char output[TIME_SIZE];
+            strcpy(output, timeService.output);
+            pthread_mutex_unlock(&timeService.lock);
+            FILE* file = fopen(TIME_FILE, "w");
+            if (file != NULL) {
+                fprintf(file, "%s", output);
+                fclose(file);
+            }
+            pthread_mutex_lock(&timeService.lock);
+        }
+    }
+    pthread_mutex_unlock(&timeService.lock);
+    return NULL;
+}
+
+//puts the current time, formatted by the time thread, into output (TIME_SIZE bytes)
+void RequestTime(char *output) {
+    if (!timeService.isRunning) {
+        time_t t = time(NULL);
+        struct tm tmp;
+        localtime_r(&t, &tmp);
+        strftime(output, TIME_SIZE, "%l:%M%P, %A, %B %d, %Y", &tmp);
+        return;
+    }
 
-    printf("\n%s\n\n", output);
+    pthread_mutex_lock(&timeService.lock);
+    timeService.isAnswered = 0;
+    timeService.isRequested = 1;
+    pthread_cond_broadcast(&timeService.changed);
+    while (!timeService.isAnswered)
+        pthread_cond_wait(&timeService.changed, &timeService.lock);
+    strcpy(output, timeService.output);
+    pthread_mutex_unlock(&timeService.lock);
 }
 
-//2nd thread creates a file with current time in same directory
-void recordTime() {
-    //time thread locks and prevents main thread from running
-    pthread_mutex_lock(&lock);
+//lets the time thread finish what it is doing and waits for it to end
+void StopTimeService() {
+    if (!timeService.isRunning)
+        return;
+    pthread_mutex_lock(&timeService.lock);
+    timeService.isStopping = 1;
+    pthread_cond_broadcast(&timeService.changed);
+    pthread_mutex_unlock(&timeService.lock);
+    pthread_join(timeService.thread, NULL);
+    timeService.isRunning = 0;
+}
 
+//returns true if user location is at the end room
+int IsEndRoom(struct World *world, int currentLocation) {
+    return world->types[currentLocation] == END_ROOM;
+}
 
-    //create string for time format
-    char output[100];
-    memset(output, '\0', 100);
-    time_t t = time(NULL);
-    struct tm *tmp = localtime(&t);
 
-    //1:03pm, Tuesday, September 13, 2016
-    if (strftime(output, 100, "%l:%M%P, %A, %B %d, %Y", tmp) == 0)
-        printf("Warning! Error with recording time in correct format with strftime.");
+////E. Shortest Path Solver ----------------------------------------------------------------
+//function prototypes to prevent implicit declaration issues
+void SolveWorld(struct World *);
+void SolveSequential(struct World *, int);
+void SolveParallel(struct World *, int);
+void* SolveWorker(void *);
+void CountFound(struct SolveState *, int, int, int);
+
+//finds for every room the next room on a shortest way to the end room, searching breadth first from the end room.
+//connections go both ways (gel.buildrooms always makes them in pairs), so a way found from the end is walkable
+//from the start. a hint is then one array read, wherever the player is
+void SolveWorld(struct World *world) {
+    world->shortestSteps = -1;
+    int endRoom;
+    for (endRoom = 0; endRoom < world->roomCount && world->types[endRoom] != END_ROOM; endRoom++)
+        ;
+    if (endRoom == world->roomCount) {
+        memset(world->nextHop, 0xff, world->roomCount * sizeof(int32_t)); //every hop -1
+        return;
+    }
 
-    //write time to new file
-    FILE* file = fopen(TIME_FILE, "w");
-    fprintf(file, "%s", output);
-    fclose(file);
+    if (world->roomCount >= SOLVE_THREAD_ROOMS && sysconf(_SC_NPROCESSORS_ONLN) > 1)
+        SolveParallel(world, endRoom);
+    else
+        SolveSequential(world, endRoom);
+}
 
-    //time thread unlocks, and after this function gets destroyed
-    pthread_mutex_unlock(&lock);
+//plain breadth first search with a queue
+void SolveSequential(struct World *world, int endRoom) {
+    int32_t *queue = (int32_t*) malloc(world->roomCount * sizeof(int32_t));
+    int head = 0, tail = 0, roundEnd, round = 0;
+    memset(world->nextHop, 0xff, world->roomCount * sizeof(int32_t));
+    world->nextHop[endRoom] = endRoom;
+    queue[tail++] = endRoom;
+
+    while (head < tail) {
+        //one round of the search is everything one step further from the end room
+        for (roundEnd = tail; head < roundEnd; head++) {
+            int room = queue[head];
+            if (room == world->startRoom)
+                world->shortestSteps = round;
+            uint32_t i;
+            for (i = world->adjacencyOffsets[room]; i < world->adjacencyOffsets[room+1]; i++) {
+                uint32_t neighbor = world->adjacency[i];
+                if (world->nextHop[neighbor] == -1) {
+                    world->nextHop[neighbor] = room;
+                    queue[tail++] = neighbor;
+                }
+            }
+        }
+        round++;
+    }
+    free(queue);
 }
 
-//returns true if user location is at the end room
-int IsEndRoom(struct Room *currentLocation) {
-    if (strcmp(currentLocation->type, "END_ROOM") == 0)
-        return 1;
-    else
-        return 0;
+//direction-optimizing breadth first search over bitsets. while the frontier is small, its rooms mark their
+//unseen neighbors (top down). once the frontier's connections outnumber a fraction of the unseen ones, it is
+//cheaper to let every unseen room look for any neighbor in the frontier and stop at the first (bottom up).
+//rounds are split across threads by ranges of bitset words, with barriers between the steps of a round
+void SolveParallel(struct World *world, int endRoom) {
+    struct SolveState state;
+    state.world = world;
+    state.wordCount = (world->roomCount + 63) / 64;
+    state.visited = (uint64_t*) calloc(state.wordCount, sizeof(uint64_t));
+    state.frontier = (uint64_t*) calloc(state.wordCount, sizeof(uint64_t));
+    state.next = (uint64_t*) calloc(state.wordCount, sizeof(uint64_t));
+    state.threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+    if (state.threadCount > MAX_SOLVE_THREADS)
+        state.threadCount = MAX_SOLVE_THREADS;
+    state.isBottomUp = 0;
+    state.isDone = 0;
+    state.round = 0;
+
+    //the end room is found in round 0; bits past the last room count as visited so they are never searched
+    memset(world->nextHop, 0xff, world->roomCount * sizeof(int32_t));
+    world->nextHop[endRoom] = endRoom;
+    state.visited[endRoom / 64] |= 1ULL << (endRoom % 64);
+    state.frontier[endRoom / 64] |= 1ULL << (endRoom % 64);
+    if (world->roomCount % 64 != 0)
+        state.visited[state.wordCount - 1] |= ~0ULL << (world->roomCount % 64);
+    if (endRoom == world->startRoom)
+        world->shortestSteps = 0;
+
+    //this thread is worker 0 and makes the decisions between rounds
+    pthread_barrier_init(&state.barrier, NULL, state.threadCount);
+    pthread_t threadIds[MAX_SOLVE_THREADS];
+    struct SolveArgument arguments[MAX_SOLVE_THREADS];
+    int i;
+    for (i = 0; i < state.threadCount; i++) {
+        arguments[i].state = &state;
+        arguments[i].index = i;
+    }
+    for (i = 1; i < state.threadCount; i++) {
+        if (pthread_create(&threadIds[i], NULL, SolveWorker, &arguments[i]) != 0) {
+            //can't run with fewer threads than the barrier waits for; the threads started so far are waiting on
+            //it, so it can't be replaced either. best to stop here
+            printf("Warning! Error creating solver thread.");
+            exit(1);
+        }
+    }
+    SolveWorker(&arguments[0]);
+    for (i = 1; i < state.threadCount; i++)
+        pthread_join(threadIds[i], NULL);
+
+    pthread_barrier_destroy(&state.barrier);
+    free(state.visited);
+    free(state.frontier);
+    free(state.next);
+}
+
+//one thread of SolveParallel(). argument is its struct SolveArgument
+void* SolveWorker(void *argument) {
+    struct SolveState *state = ((struct SolveArgument*) argument)->state;
+    int index = ((struct SolveArgument*) argument)->index;
+    struct World *world = state->world;
+    int first = (long long) state->wordCount * index / state->threadCount;
+    int last = (long long) state->wordCount * (index + 1) / state->threadCount;
+    long long unseenEdges = world->adjacencyOffsets[world->roomCount]; //only worker 0 keeps this up to date
+    long long frontierEdges = 0, frontierCount = 1;
+    int w;
+
+    while (1) {
+        //next is the frontier of two rounds ago; in top down mode any thread may set bits in any word of it
+        memset(state->next + first, 0, (last - first) * sizeof(uint64_t));
+        pthread_barrier_wait(&state->barrier);
+
+        if (!state->isBottomUp) {
+            for (w = first; w < last; w++) {
+                uint64_t bits = state->frontier[w];
+                while (bits != 0) {
+                    int room = w * 64 + __builtin_ctzll(bits);
+                    bits &= bits - 1;
+                    uint32_t i;
+                    for (i = world->adjacencyOffsets[room]; i < world->adjacencyOffsets[room+1]; i++) {
+                        uint32_t neighbor = world->adjacency[i];
+                        uint64_t bit = 1ULL << (neighbor % 64);
+                        if (__atomic_load_n(&state->visited[neighbor / 64], __ATOMIC_RELAXED) & bit)
+                            continue;
+                        //several frontier rooms may reach the same neighbor; the one that sets the bit wins
+                        if ((__atomic_fetch_or(&state->visited[neighbor / 64], bit, __ATOMIC_RELAXED) & bit) == 0) {
+                            world->nextHop[neighbor] = room;
+                            __atomic_fetch_or(&state->next[neighbor / 64], bit, __ATOMIC_RELAXED);
+                        }
+                    }
+                }
+            }
+        }
+        else {
+            //each thread only writes its own words, so nothing needs to be atomic here
+            for (w = first; w < last; w++) {
+                uint64_t unseen = ~state->visited[w];
+                while (unseen != 0) {
+                    int room = w * 64 + __builtin_ctzll(unseen);
+                    unseen &= unseen - 1;
+                    uint32_t i;
+                    for (i = world->adjacencyOffsets[room]; i < world->adjacencyOffsets[room+1]; i++) {
+                        uint32_t neighbor = world->adjacency[i];
+                        if (state->frontier[neighbor / 64] & (1ULL << (neighbor % 64))) {
+                            world->nextHop[room] = neighbor;
+                            state->next[w] |= 1ULL << (room % 64);
+                            break;
+                        }
+                    }
+                }
+                state->visited[w] |= state->next[w];
+            }
+        }
+        pthread_barrier_wait(&state->barrier);
+
+        CountFound(state, index, first, last);
+        pthread_barrier_wait(&state->barrier);
+
+        //worker 0 sums up the round, swaps next into the frontier and picks the direction of the next round
+        if (index == 0) {
+            long long foundCount = 0, foundEdges = 0;
+            int t;
+            for (t = 0; t < state->threadCount; t++) {
+                foundCount += state->threadFound[t];
+                foundEdges += state->threadEdges[t];
+            }
+            state->round++;
+            int startRoom = world->startRoom;
+            if (startRoom >= 0 && (state->next[startRoom / 64] & (1ULL << (startRoom % 64))))
+                world->shortestSteps = state->round;
+
+            uint64_t *swap = state->frontier;
+            state->frontier = state->next;
+            state->next = swap;
+            unseenEdges -= frontierEdges;
+            frontierEdges = foundEdges;
+            int wasGrowing = foundCount > frontierCount;
+            frontierCount = foundCount;
+            if (!state->isBottomUp && wasGrowing && frontierEdges > unseenEdges / TOP_DOWN_FACTOR)
+                state->isBottomUp = 1;
+            else if (state->isBottomUp && !wasGrowing && frontierCount < world->roomCount / BOTTOM_UP_FACTOR)
+                state->isBottomUp = 0;
+            state->isDone = (foundCount == 0);
+        }
+        pthread_barrier_wait(&state->barrier);
+        if (state->isDone)
+            return NULL;
+    }
 }
 
-//returns index of start room
-int IdentifyStartRoom(struct Room** rooms) {
+//counts the rooms this thread's words of next hold, and their connections
+void CountFound(struct SolveState *state, int index, int first, int last) {
+    struct World *world = state->world;
+    long long found = 0, edges = 0;
+    int w;
+    for (w = first; w < last; w++) {
+        uint64_t bits = state->next[w];
+        found += __builtin_popcountll(bits);
+        while (bits != 0) {
+            int room = w * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            edges += world->adjacencyOffsets[room+1] - world->adjacencyOffsets[room];
+        }
+    }
+    state->threadFound[index] = found;
+    state->threadEdges[index] = edges;
+}
+
+
+////F. Game Server ---------------------------------------------------------------------------
+//function prototypes to prevent implicit declaration issues
+int OpenListener(char *);
+int RunServer(struct World *, char *);
+void* ServeSessions(void *);
+void AcceptSessions(struct ServerWorker *, int);
+int ReadSession(struct World *, struct Session *);
+int FlushSession(int, struct Session *);
+void CloseSession(int, struct Session *);
+
+//opens a nonblocking listening socket. address is a unix socket path when it has a '/' in it, else [host:]port
+//for TCP (any host when left out). returns -1 after saying what is wrong
+int OpenListener(char *address) {
+    int listenSocket;
+    if (strchr(address, '/') != NULL) {
+        struct sockaddr_un unixAddress;
+        memset(&unixAddress, 0, sizeof(unixAddress));
+        unixAddress.sun_family = AF_UNIX;
+        if (strlen(address) >= sizeof(unixAddress.sun_path)) {
+            fprintf(stderr, "Socket path %s is too long.\n", address);
+            return -1;
+        }
+        strcpy(unixAddress.sun_path, address);
+        unlink(address); //left over from an earlier server
+        listenSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listenSocket == -1 || bind(listenSocket, (struct sockaddr*) &unixAddress, sizeof(unixAddress)) == -1) {
+            perror("Cannot listen on unix socket");
+            return -1;
+        }
+    }
+    else {
+        char host[256] = "";
+        char *port = strrchr(address, ':');
+        if (port != NULL) {
+            snprintf(host, sizeof(host), "%.*s", (int) (port - address), address);
+            port++;
+        }
+        else
+            port = address;
+
+        struct addrinfo hints, *results;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        int error = getaddrinfo(host[0] != '\0' ? host : NULL, port, &hints, &results);
+        if (error != 0) {
+            fprintf(stderr, "Cannot listen on %s: %s\n", address, gai_strerror(error));
+            return -1;
+        }
+        listenSocket = socket(results->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int yes = 1;
+        if (listenSocket != -1)
+            setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        if (listenSocket == -1 || bind(listenSocket, results->ai_addr, results->ai_addrlen) == -1) {
+            perror("Cannot listen on TCP port");
+            freeaddrinfo(results);
+            return -1;
+        }
+        freeaddrinfo(results);
+    }
+
+    if (listen(listenSocket, SOMAXCONN) == -1) {
+        perror("Cannot listen");
+        return -1;
+    }
+    return listenSocket;
+}
+
+//serves the game to everyone who connects, until killed. one worker thread per core, each with its own epoll;
+//the listening socket is in all of them and the kernel wakes one worker per new connection. a session stays
+//with the worker that accepted it, so workers share nothing but the (read-only) world
+int RunServer(struct World *world, char *address) {
+    int listenSocket = OpenListener(address);
+    if (listenSocket == -1)
+        return 1;
+    signal(SIGPIPE, SIG_IGN);
+
+    int workerCount = sysconf(_SC_NPROCESSORS_ONLN);
+    if (workerCount < 1)
+        workerCount = 1;
+    if (workerCount > MAX_SERVER_WORKERS)
+        workerCount = MAX_SERVER_WORKERS;
+    fprintf(stderr, "Serving %d rooms on %s with %d workers.\n", world->roomCount, address, workerCount);
+
+    //this thread is the last worker
+    struct ServerWorker workers[MAX_SERVER_WORKERS];
     int i;
-    for (i = 0; i < ROOM_COUNT; i++) {
-        if (strcmp(rooms[i]->type, "START_ROOM") == 0)
-            return i;
+    for (i = 0; i < workerCount; i++) {
+        workers[i].world = world;
+        workers[i].listenSocket = listenSocket;
+        if (i < workerCount - 1 && pthread_create(&workers[i].thread, NULL, ServeSessions, &workers[i]) != 0)
+            fprintf(stderr, "Warning! Could not start server worker %d.\n", i);
     }
+    ServeSessions(&workers[workerCount - 1]);
+    return 1; //only gets here if the worker couldn't set up
+}
 
-    printf("Warning! Could not find start room!");
-    return -1;
+//worker thread: runs the sessions it accepted
+void* ServeSessions(void *argument) {
+    struct ServerWorker *worker = (struct ServerWorker*) argument;
+    int epollDescriptor = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLEXCLUSIVE;
+    event.data.ptr = NULL; //the listening socket has no session
+    if (epollDescriptor == -1 || epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, worker->listenSocket, &event) == -1) {
+        perror("Server worker cannot wait for connections");
+        return NULL;
+    }
+
+    struct epoll_event events[SERVER_EVENTS];
+    while (1) {
+        int count = epoll_wait(epollDescriptor, events, SERVER_EVENTS, -1);
+        int i;
+        for (i = 0; i < count; i++) {
+            struct Session *session = (struct Session*) events[i].data.ptr;
+            if (session == NULL) {
+                AcceptSessions(worker, epollDescriptor);
+                continue;
+            }
+
+            //a session waits for its output to drain before reading more, so a client that doesn't read
+            //can't make the server buffer without end
+            int result = 0;
+            if (events[i].events & (EPOLLERR | EPOLLHUP))
+                result = -1;
+            else if (events[i].events & EPOLLIN)
+                result = ReadSession(worker->world, session);
+            if (result != -1)
+                result = FlushSession(epollDescriptor, session);
+            if (result == -1)
+                CloseSession(epollDescriptor, session);
+        }
+    }
+    return NULL;
+}
+
+//takes every waiting connection, greets it with the first prompt and adds it to the worker's epoll
+void AcceptSessions(struct ServerWorker *worker, int epollDescriptor) {
+    while (1) {
+        int socket = accept4(worker->listenSocket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (socket == -1)
+            return; //EAGAIN: another worker got it or none left; anything else: try again on the next wakeup
+
+        struct Session *session = (struct Session*) calloc(1, sizeof(struct Session));
+        session->socket = socket;
+        AddToPath(&session->path, worker->world->startRoom);
+        AddPrompt(&session->output, worker->world, worker->world->startRoom);
+
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.ptr = session;
+        if (epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, socket, &event) == -1 ||
+            FlushSession(epollDescriptor, session) == -1)
+            CloseSession(-1, session);
+    }
+}
+
+//reads what the player sent and plays every whole word of it, adding the answers to the output.
+//returns -1 if the player left
+int ReadSession(struct World *world, struct Session *session) {
+    char data[4096];
+    ssize_t count = recv(session->socket, data, sizeof(data), 0);
+    if (count == 0 || (count == -1 && errno != EAGAIN && errno != EINTR))
+        return -1;
+
+    ssize_t i;
+    for (i = 0; i < count && !session->isFinished; i++) {
+        if (!AddInput(session->input, &session->inputLength, data[i]))
+            continue;
+
+        int room = session->path.rooms[session->path.count - 1];
+        int next = ApplyInput(&session->output, world, room, session->input);
+        if (next != -1) {
+            AddToPath(&session->path, next);
+            room = next;
+        }
+        if (IsEndRoom(world, room)) {
+            size_t length;
+            char *text = EndScreen(world, &session->path, &length);
+            BufferAdd(&session->output, text, length);
+            free(text);
+            session->isFinished = 1;
+        }
+        else
+            AddPrompt(&session->output, world, room);
+    }
+    return 0;
+}
+
+//sends as much output as the socket takes. while some is left, the session waits for the socket to be writable
+//instead of readable. returns -1 if the session is over: output all sent after the end, or the socket broke
+int FlushSession(int epollDescriptor, struct Session *session) {
+    while (session->outputSent < session->output.length) {
+        ssize_t count = send(session->socket, session->output.text + session->outputSent,
+                             session->output.length - session->outputSent, MSG_NOSIGNAL);
+        if (count == -1 && errno == EINTR)
+            continue;
+        if (count == -1 && errno == EAGAIN)
+            break;
+        if (count <= 0)
+            return -1;
+        session->outputSent += count;
+    }
+
+    int isDrained = (session->outputSent == session->output.length);
+    if (isDrained) {
+        session->output.length = 0;
+        session->outputSent = 0;
+        if (session->isFinished)
+            return -1;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = isDrained ? EPOLLIN : EPOLLOUT;
+    event.data.ptr = session;
+    epoll_ctl(epollDescriptor, EPOLL_CTL_MOD, session->socket, &event);
+    return 0;
+}
+
+//ends a session. epollDescriptor -1 if it was never added
+void CloseSession(int epollDescriptor, struct Session *session) {
+    if (epollDescriptor != -1)
+        epoll_ctl(epollDescriptor, EPOLL_CTL_DEL, session->socket, NULL);
+    close(session->socket);
+    free(session->path.rooms);
+    free(session->output.text);
+    free(session);
 }
 
 
-////E. MAIN -------------------------------------------------------------------------------
-int main() {
-    //main thread will always grab this lock
-    pthread_mutex_lock(&lock);
+////G. MAIN -------------------------------------------------------------------------------
+//usage: gel.adventure [--autoplay] [--no-time-file] [--record file] [--replay file] [--batch file [--quiet]]
+//                     [--serve address]
+//--autoplay plays the game by itself along a shortest path, to check the solver or time huge worlds.
+//--no-time-file leaves currentTime.txt alone when asked for the time.
+//--record writes the path of the finished game to a file, which --replay plays back without asking anything;
+//a replay that stops short of the end room goes on asking (or autoplaying) from there.
+//--batch plays the moves in a file ("-" for stdin) like typed ones, without the per-move reads and writes, and
+//reports moves/s and load time on stderr; --quiet leaves out everything but the end screen. moves that run out
+//before the end room go on the same way as a short replay.
+//--serve address runs a game server on a unix socket path (with a '/') or [host:]port for everyone who connects
+int main(int argc, char *argv[]) {
+    char *serveAddress = NULL;
+    int i;
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--autoplay") == 0)
+            isAutoplay = 1;
+        else if (strcmp(argv[i], "--no-time-file") == 0)
+            timeService.isWritingFile = 0;
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            recordFile = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+            replayFile = argv[++i];
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+            batchFile = argv[++i];
+        else if (strcmp(argv[i], "--quiet") == 0)
+            isQuiet = 1;
+        else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc)
+            serveAddress = argv[++i];
+        else {
+            fprintf(stderr, "usage: %s [--autoplay] [--no-time-file] [--record file] [--replay file] "
+                            "[--batch file [--quiet]] [--serve address]\n", argv[0]);
+            return 2;
+        }
+    }
 
-    //create second thread, which is idling until recordTime() is called
-    int resultInt1;
-    pthread_t threadId1;
-    resultInt1 = pthread_create(&threadId1, NULL, (void*) recordTime, NULL);
-    if (resultInt1 != 0)
-        printf("Warning! Error creating thread #1 for recording time.");
+    //create second thread, which is idling until the time is asked for
+    StartTimeService();
 
     //get most recent relevant rooms directory
+    double start = Seconds();
     char *roomDir;
     roomDir = MostRecentRoomsDir();
+    if (roomDir == NULL)
+        return 1;
 
     //initialize game data in memory based on file data
-    struct Room** rooms = FillRoomsData(roomDir);
+    struct World world;
+    LoadWorld(roomDir, &world);
+    if (world.startRoom == -1) {
+        FreeWorld(&world);
+        free(roomDir);
+        return 1;
+    }
+    loadSeconds = Seconds() - start;
+    SolveWorld(&world);
+    solveSeconds = Seconds() - start - loadSeconds;
+    if (serveAddress != NULL)
+        return RunServer(&world, serveAddress);
 
     //start the game
-    BeginGame(rooms);
+    BeginGame(&world);
 
     //free up anything else malloc'd
-    FreeMemory(rooms);
+    FreeWorld(&world);
     free(roomDir);
 
     return 0;
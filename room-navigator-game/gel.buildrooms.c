@@ -1,10 +1,14 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <time.h>
 #include <memory.h>
 #include <sys/stat.h>
-#include <zconf.h>
+#include <unistd.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <errno.h>
 
 
 ////A. Global variables required for rooom initial setup -------------------------------------------------------------
@@ -13,12 +17,40 @@
 #define MAX_CONNECTION_COUNT    6
 #define MIN_CONNECTION_COUNT    3
 #define DIRECTORY_PREFIX        "gel.rooms."
+#define BATCH_PREFIX  "gel.batch."  //-k: directory holding one rooms directory per world of the batch
+#define LATEST_LINK   "gel.latest"  //symlink to the newest rooms directory, so gel.adventure needn't look through all
+#define NAME_COUNT    10
+#define FIXUP_TRIES   64    //random partners tried for a room still short of connections before scanning them all
+#define WORLD_FILE    ".world"  //binary copy of the world in the rooms directory; hidden so room file readers skip it
+#define WORLD_MAGIC   "GELW"
+#define WORLD_VERSION 1
+#define BITSET_MAX_ROOMS  4096  //worlds up to this many rooms check for repeated connections in a bitset (2 MB)
+#define MAX_BATCH_THREADS 64
+
+//room types, stored as one byte per room in the world file
+enum RoomType {MID_ROOM, START_ROOM, END_ROOM};
+char *typeNames[] = {"MID_ROOM", "START_ROOM", "END_ROOM"};
+
+//world file layout: this header, then (all native byte order)
+//  uint32 nameOffsets[roomCount + 1]       room i's name is names[nameOffsets[i]], NUL terminated
+//  uint32 adjacencyOffsets[roomCount + 1]  room i's connections are adjacency[adjacencyOffsets[i] .. [i + 1])
+//  uint32 adjacency[connectionCount]       room indices; each connection is listed at both of its rooms
+//  uint8  types[roomCount]                 MID_ROOM, START_ROOM or END_ROOM
+//  char   names[nameBytes]
+struct WorldHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t roomCount;
+    uint32_t connectionCount;
+    uint32_t nameBytes;
+    uint32_t reserved;
+};
 
 //each room will be instantiated later as struct with all necessary information to setup
 struct Room {
     char *name;
-    char *type;
-    struct Room **connection;
+    enum RoomType type;
+    int *connection;        //indices of connected rooms, MAX connections' worth of room in a shared array
     int connectionCount;
 };
 
@@ -36,281 +68,641 @@ char *names[] = {
         "France"
 };
 
+//world parameters, set from the command line in main()
+int roomCount = ROOM_COUNT;
+int minConnections = MIN_CONNECTION_COUNT;
+int maxConnections = MAX_CONNECTION_COUNT;
+int isBinaryOnly = 0;       //-b: skip the text room files, only write the world file
+int batchCount = 0;         //-k: build this many worlds at once instead of one
+int batchThreads = 0;       //-j: threads building the batch, 0 for one per cpu
+
+//storage shared by all rooms so a world of millions of rooms is a handful of allocations.
+//each thread of a batch builds its own worlds, so these belong to the thread
+__thread int *connectionPool;       //roomCount * maxConnections room indices
+__thread char *namePool;            //all room names, NUL terminated, back to back
+__thread uint64_t *adjacencyBits;   //bit x * roomCount + y is set if x and y are connected; NULL past BITSET_MAX_ROOMS
+
+//state of the random number generator (splitmix64); same seed, same world
+__thread uint64_t randomState;
+
+//a batch being built: worlds are handed out one at a time to whichever thread is free
+struct Batch {
+    char directoryName[32];
+    uint64_t seed;          //world k is built from WorldSeed(seed, k)
+    int nextWorld;
+    int failedWorlds;
+    pthread_mutex_t nextLock;
+};
+
 
 ////B. Functions for room initialization and setup--------------------------------------------------------------------
 
-//Generates a random unique array of integers from 0 to 9 using Knuth algorithm. Then just shuffles around within array
-//This is used to efficiently select random unique names.
-#define RANGE   7
-#define VALUES   10
-int* ShuffleIntArray() {
-    int in, im;
-    int *randomNum = malloc(sizeof(int)*RANGE);
-    im = 0;
-
-    //Knuth algorithm
-    for (in = 0; in < VALUES && im < RANGE; ++in) {
-        int rn = VALUES - in;
-        int rm = RANGE - im;
-        if (rand() % rn < rm)
-            randomNum[im++] = in;
-    }
+//Next 64 random bits from the splitmix64 generator
+uint64_t NextRandom() {
+    uint64_t z = (randomState += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
 
-//    for (int l = 0; l < RANGE; l++)
-//        printf("%d ", randomNum[l]);
+//Random integer from 0 to n-1
+int RandomBelow(int n) {
+    return (int) (NextRandom() % (uint64_t) n);
+}
 
-    //reshuffle by swapping values randomly within the array
+//Shuffles an int array in place with Fisher-Yates, so every order is equally likely
+void ShuffleIntArray(int *values, int count) {
     int i;
-    for (i = 0; i < RANGE; i++) {
-        int j = rand() % RANGE; //0-6
-        int temp = randomNum[j];
-        randomNum[j] = randomNum[i];
-        randomNum[i] = temp;
+    for (i = count - 1; i > 0; i--) {
+        int j = RandomBelow(i + 1);
+        int temp = values[j];
+        values[j] = values[i];
+        values[i] = temp;
     }
-
-//    printf("\n");
-//    for (int k = 0; k < RANGE; k++)
-//        printf("%d ", randomNum[k]);
-
-    return randomNum;
 }
 
 //Primary setup: allocates memory for room structs and connections. Sets up names and room types as well.
 //Returns a Rooms pointer as a handle for further modification and also to free() later on.
-struct Room** SetupRooms () {
-    struct Room **rooms = (struct Room**) malloc(sizeof(struct Room*)*ROOM_COUNT);
-
-    srand(time(NULL));
-    int *values = ShuffleIntArray(); //generate random unique int to assign names
+struct Room* SetupRooms () {
+    struct Room *rooms = (struct Room*) malloc(sizeof(struct Room)*roomCount);
+    connectionPool = (int*) malloc(sizeof(int)*roomCount*maxConnections);
+    adjacencyBits = NULL;
+    if (roomCount <= BITSET_MAX_ROOMS)
+        adjacencyBits = (uint64_t*) calloc(((size_t) roomCount*roomCount + 63) / 64, sizeof(uint64_t));
+
+    //up to 10 rooms get distinct names from names[] in random order. more rooms than that get the names with a
+    //number added ("Peru12"), which is unique as the number is the room index divided by 10
+    int *values = (int*) malloc(sizeof(int)*NAME_COUNT);
     int i;
-    for (i = 0; i < ROOM_COUNT; i++) {
-        //allocate memory for a room and initialize
-        rooms[i] = (struct Room*) malloc(sizeof(struct Room));
-
-        rooms[i]->name = names[values[i]];
-
-        //given randomized values, just setup first 2 rooms as start/end, rest as mid
-        if (i == 0)
-            rooms[i]->type = "START_ROOM";
-        else if (i == 1)
-            rooms[i]->type = "END_ROOM";
+    for (i = 0; i < NAME_COUNT; i++)
+        values[i] = i;
+    ShuffleIntArray(values, NAME_COUNT);
+
+    size_t nameSpace = (size_t) roomCount * 20;
+    namePool = (char*) malloc(nameSpace);
+    char *nextName = namePool;
+    for (i = 0; i < roomCount; i++) {
+        rooms[i].name = nextName;
+        if (roomCount <= NAME_COUNT)
+            nextName += sprintf(nextName, "%s", names[values[i]]) + 1;
         else
-            rooms[i]->type = "MID_ROOM";
-
-        //space for 6 Room pointers to other Room structs
-        rooms[i]->connection = (struct Room**) malloc(sizeof(struct Room*)*MAX_CONNECTION_COUNT);
+            nextName += sprintf(nextName, "%s%d", names[values[i % NAME_COUNT]], i / NAME_COUNT) + 1;
 
-        //set count to 0, which gets incremented as we create connections
-        rooms[i]->connectionCount = 0;
+        rooms[i].type = MID_ROOM;
+        rooms[i].connection = &connectionPool[(size_t) i*maxConnections];
+        rooms[i].connectionCount = 0;
     }
     free(values); //make sure to free the int array used to generate room name assignment
 
+    //random, distinct start and end rooms
+    int start = RandomBelow(roomCount);
+    int end = (start + 1 + RandomBelow(roomCount - 1)) % roomCount;
+    rooms[start].type = START_ROOM;
+    rooms[end].type = END_ROOM;
+
     return rooms;
 }
 
 //free all allocated memory, namely for structures and connections
-void FreeMemory (struct Room **rooms) {
-    int i;
-    for (i = 0; i < ROOM_COUNT; i++) {
-        free(rooms[i]->connection);
-        free(rooms[i]);
-    }
-
+void FreeMemory (struct Room *rooms) {
+    free(connectionPool);
+    free(namePool);
+    free(adjacencyBits);
     free(rooms);
 }
 
 
 ////C. Functions to create connections between all initialized rooms -----------------------------------------------
 //declaring all function prototypes to avoid implicit declaration issues
-void AddRandomConnection(struct Room **);
-struct Room* GetRandomRoom(struct Room **);
 int CanAddConnectionFrom(struct Room *);
-int ConnectionAlreadyExists(struct Room *, struct Room *);
-void ConnectRoom(struct Room *, struct Room *);
-int IsSameRoom(struct Room *, struct Room *);
-int IsGraphFull(struct Room **);
-void SetupAllConnections(struct Room **);
-
+int ConnectionAlreadyExists(struct Room *, int, int);
+void SetAdjacency(int, int, int);
+void ConnectRoom(struct Room *, int, int);
+int CanConnect(struct Room *, int, int);
+int ConnectShortRoom(struct Room *, int);
+int ConnectTwoShortRooms(struct Room *, int);
+int SetupAllConnections(struct Room *);
+
+
+//Makes random, valid connections until all rooms have min to max connections, in time linear in the room count:
+//1. a random cycle through all rooms, so every room can be reached from every other one (start to end included)
+//2. every room gets a random target degree between min and max. the connections still missing are handed out as
+//   "stubs", shuffled and paired up two by two (a random graph with those degrees); pairs that would be a self
+//   connection or a repeated one are skipped
+//3. any room still short of min connections is connected to random rooms with room to spare
+//returns 0, or -1 (after a warning) if some room can't be given enough connections
+int SetupAllConnections(struct Room *rooms) {
+    int i, j;
+
+    //1. random cycle (or a single connection for 2 rooms)
+    int *order = (int*) malloc(sizeof(int)*roomCount);
+    for (i = 0; i < roomCount; i++)
+        order[i] = i;
+    ShuffleIntArray(order, roomCount);
+    for (i = 0; i + 1 < roomCount; i++)
+        ConnectRoom(rooms, order[i], order[i + 1]);
+    if (roomCount > 2)
+        ConnectRoom(rooms, order[roomCount - 1], order[0]);
+    free(order);
+
+    //2. stubs for the rest of each room's target degree, paired at random
+    size_t stubCount = 0;
+    int *targets = (int*) malloc(sizeof(int)*roomCount);
+    for (i = 0; i < roomCount; i++) {
+        targets[i] = minConnections + RandomBelow(maxConnections - minConnections + 1);
+        if (targets[i] > rooms[i].connectionCount)
+            stubCount += targets[i] - rooms[i].connectionCount;
+    }
+    int *stubs = (int*) malloc(sizeof(int)*(stubCount > 0 ? stubCount : 1));
+    size_t s = 0;
+    for (i = 0; i < roomCount; i++) {
+        for (j = rooms[i].connectionCount; j < targets[i]; j++)
+            stubs[s++] = i;
+    }
+    free(targets);
+    for (s = stubCount; s > 1; s--) {
+        size_t k = NextRandom() % s;
+        int temp = stubs[k];
+        stubs[k] = stubs[s - 1];
+        stubs[s - 1] = temp;
+    }
+    for (s = 0; s + 1 < stubCount; s += 2) {
+        if (CanConnect(rooms, stubs[s], stubs[s + 1]))
+            ConnectRoom(rooms, stubs[s], stubs[s + 1]);
+    }
+    free(stubs);
 
-//Makes random, valid connections with rooms until all rooms have at least 3-6 connections
-void SetupAllConnections(struct Room **rooms) {
-    while (IsGraphFull(rooms) == 0) {
-        AddRandomConnection(rooms);
+    //3. fix up rooms the pairing left short
+    for (i = 0; i < roomCount; i++) {
+        while (rooms[i].connectionCount < minConnections) {
+            if (ConnectShortRoom(rooms, i) == -1)
+                return -1;
+        }
     }
+    return 0;
 }
 
-// Returns true if all rooms have 3 to 6 outbound connections, false otherwise
-int IsGraphFull(struct Room **rooms) {
-    int i;
-    for (i = 0; i < ROOM_COUNT; i++) {
-        if (rooms[i]->connectionCount < MIN_CONNECTION_COUNT)
+//Gives room x one more connection: tries random partners first, then every room in turn. A partner that is full
+//gives up one of its connections (to a room other than x) and x takes it over, so the partner's count stays the
+//same and the other room is no worse off than before x came along. returns -1 if nothing works
+int ConnectShortRoom(struct Room *rooms, int x) {
+    int tries, y;
+    for (tries = 0; tries < FIXUP_TRIES; tries++) {
+        y = RandomBelow(roomCount);
+        if (CanConnect(rooms, x, y)) {
+            ConnectRoom(rooms, x, y);
             return 0;
+        }
     }
-
-    return 1;
-}
-
-// Adds a random, valid outbound connection from a Room to another Room
-void AddRandomConnection(struct Room **rooms) {
-    struct Room *A = GetRandomRoom(rooms);
-    struct Room *B = GetRandomRoom(rooms);
-
-//    printf("RoomA %s\n", A->name);
-//    printf("RoomB %s\n", B->name);
-
-    //takes a random room that can still make connection
-    while(1) {
-        A = GetRandomRoom(rooms);
-        if (CanAddConnectionFrom(A) == 1)
-            break;
+    for (y = 0; y < roomCount; y++) {
+        if (CanConnect(rooms, x, y)) {
+            ConnectRoom(rooms, x, y);
+            return 0;
+        }
     }
 
-    do {
-        B = GetRandomRoom(rooms);
+    //everyone in reach is full: split a connection y-z (z not connected to x) into x-y and x-z
+    for (y = 0; y < roomCount && rooms[x].connectionCount + 2 <= maxConnections; y++) {
+        if (y == x || ConnectionAlreadyExists(rooms, x, y))
+            continue;
+        int k;
+        for (k = 0; k < rooms[y].connectionCount; k++) {
+            int z = rooms[y].connection[k];
+            if (z == x || ConnectionAlreadyExists(rooms, x, z))
+                continue;
+            //y's slot for z now points to x; z's slot for y now points to x
+            rooms[y].connection[k] = x;
+            int m;
+            for (m = 0; rooms[z].connection[m] != y; m++)
+                ;
+            rooms[z].connection[m] = x;
+            rooms[x].connection[rooms[x].connectionCount++] = y;
+            rooms[x].connection[rooms[x].connectionCount++] = z;
+            SetAdjacency(y, z, 0);
+            SetAdjacency(x, y, 1);
+            SetAdjacency(x, z, 1);
+            return 0;
+        }
     }
-    while(CanAddConnectionFrom(B) == 0 || IsSameRoom(A, B) == 1 || ConnectionAlreadyExists(A, B) == 1);
-
-//    printf("Connecting %s with %s.\n", A->name, B->name);
 
-    ConnectRoom(A, B);
+    //x has one free slot left, and so has some other room it can't connect to (the connection counts add up
+    //to an even number, so x can't be the only room with a free slot)
+    if (ConnectTwoShortRooms(rooms, x) == 0)
+        return 0;
 
-    //debugging purposes:
-//    printf("Room %s connections:\n", A->name);
-//    for (int i = 0; i < A->connectionCount; i++)
-//        printf("connection %d: %s\n", i, A->connection[i]->name);
-//    printf("Room %s connections:\n", B->name);
-//    for (int j = 0; j < B->connectionCount; j++)
-//        printf("connection %d: %s\n", j, B->connection[j]->name);
-//
-//    printf("\n\n\n");
+    fprintf(stderr, "Warning, could not give room %s enough connections!\n", rooms[x].name);
+    return -1;
 }
 
-// Returns a random Room pointer from given array of Room pointers, does NOT validate if connection can be added
-struct Room* GetRandomRoom(struct Room **rooms) {
-    int i = rand() % ROOM_COUNT;
-    //printf("%d\n", i);
-    return rooms[i];
+//Gives room x and some other room y with a free slot one more connection each: a connection a-b (a not
+//connected to x, b not connected to y) becomes x-a and y-b, so a and b keep their counts. y is already connected
+//to x (else x would have taken y as a partner), so every room can still reach every other. returns -1 if there
+//is no such pair
+int ConnectTwoShortRooms(struct Room *rooms, int x) {
+    int y, a, k;
+    for (y = 0; y < roomCount; y++) {
+        if (y == x || !CanAddConnectionFrom(&rooms[y]))
+            continue;
+        for (a = 0; a < roomCount; a++) {
+            if (a == x || a == y || ConnectionAlreadyExists(rooms, x, a))
+                continue;
+            for (k = 0; k < rooms[a].connectionCount; k++) {
+                int b = rooms[a].connection[k];
+                if (b == x || b == y || ConnectionAlreadyExists(rooms, y, b))
+                    continue;
+                //a's slot for b now points to x; b's slot for a now points to y
+                rooms[a].connection[k] = x;
+                int m;
+                for (m = 0; rooms[b].connection[m] != a; m++)
+                    ;
+                rooms[b].connection[m] = y;
+                rooms[x].connection[rooms[x].connectionCount++] = a;
+                rooms[y].connection[rooms[y].connectionCount++] = b;
+                SetAdjacency(a, b, 0);
+                SetAdjacency(x, a, 1);
+                SetAdjacency(y, b, 1);
+                return 0;
+            }
+        }
+    }
+    return -1;
 }
 
-// Returns true if a connection can be added from Room x (< 6 outbound connections), false otherwise
+// Returns true if a connection can be added from Room x (< max outbound connections), false otherwise
 int CanAddConnectionFrom(struct Room *x) {
-    if (x->connectionCount < MAX_CONNECTION_COUNT)
+    if (x->connectionCount < maxConnections)
         return 1;
     else
         return 0;
 }
 
-// Returns true if a connection from Room x to Room y already exists, false otherwise
-int ConnectionAlreadyExists(struct Room *x, struct Room *y)
+// Returns true if rooms x and y are different, not connected yet, and both have room for another connection
+int CanConnect(struct Room *rooms, int x, int y) {
+    return x != y && CanAddConnectionFrom(&rooms[x]) && CanAddConnectionFrom(&rooms[y]) &&
+           !ConnectionAlreadyExists(rooms, x, y);
+}
+
+// Returns true if a connection from room x to room y already exists, false otherwise.
+// one bit lookup while the world is small enough for the bitset, else a scan of x's at most maxConnections
+int ConnectionAlreadyExists(struct Room *rooms, int x, int y)
 {
+    if (adjacencyBits != NULL) {
+        size_t bit = (size_t) x*roomCount + y;
+        return (adjacencyBits[bit / 64] >> (bit % 64)) & 1;
+    }
+
     //iterates over x's connections and checks if y is in there
     int i;
-    for (i = 0; i < x->connectionCount; i++) {
-        if (IsSameRoom(x->connection[i], y))
+    for (i = 0; i < rooms[x].connectionCount; i++) {
+        if (rooms[x].connection[i] == y)
             return 1;
     }
 
     return 0; //no connection found
 }
 
-// Connects Rooms x and y together, does not validate whatsoever.
-void ConnectRoom(struct Room *x, struct Room *y) {
-    x->connection[x->connectionCount] = y;
-    y->connection[y->connectionCount] = x;
-    x->connectionCount += 1;
-    y->connectionCount += 1;
+// Marks rooms x and y as connected (value 1) or not (value 0) in the bitset, both ways round
+void SetAdjacency(int x, int y, int value) {
+    if (adjacencyBits == NULL)
+        return;
+    size_t bits[2] = {(size_t) x*roomCount + y, (size_t) y*roomCount + x};
+    int i;
+    for (i = 0; i < 2; i++) {
+        if (value)
+            adjacencyBits[bits[i] / 64] |= 1ULL << (bits[i] % 64);
+        else
+            adjacencyBits[bits[i] / 64] &= ~(1ULL << (bits[i] % 64));
+    }
 }
 
-// Returns true if Rooms x and y are the same Room, false otherwise
-int IsSameRoom(struct Room *x, struct Room *y) {
-    if (strcmp(x->name, y->name) == 0)
-        return 1;
-    else
-        return 0;
+// Connects rooms x and y together, does not validate whatsoever.
+void ConnectRoom(struct Room *rooms, int x, int y) {
+    rooms[x].connection[rooms[x].connectionCount] = y;
+    rooms[y].connection[rooms[y].connectionCount] = x;
+    rooms[x].connectionCount += 1;
+    rooms[y].connectionCount += 1;
+    SetAdjacency(x, y, 1);
 }
 
 
 ////D. Function to output finalized data to files ----------------------------------------------------------------
-void CreateRoomFiles(struct Room **rooms) {
-    //setup directory name
-    int pid = getpid();
-    char directoryName[20];
-    memset(directoryName, '\0', 20);
-    sprintf(directoryName, DIRECTORY_PREFIX"%d", pid);
-
-    //create directory with given name
-    int fileDescriptor = mkdir(directoryName, 0777);
-
-    if (fileDescriptor == -1)
+void CreateRoomFiles(struct Room *, char *);
+void CreateWorldFile(int, struct Room *);
+void PublishLatest(char *);
+int WriteAll(int, void *, size_t);
+
+//writes the rooms into directoryName, which the caller has created already
+void CreateRoomFiles(struct Room *rooms, char *directoryName) {
+    int fileDescriptor;
+    int directoryDescriptor = open(directoryName, O_RDONLY | O_DIRECTORY);
+    if (directoryDescriptor == -1) {
         printf("Warning, directory went wrong!");
+        return;
+    }
+
+    //room file can't be longer than its name, type and max connections' worth of "CONNECTION n: name" lines
+    size_t contentSize = 64 + (size_t) maxConnections * 64;
+    char *fileContent = (char*) malloc(contentSize);
 
     //iterate through rooms and create file for each
     int i;
-    for (i = 0; i < ROOM_COUNT; i++) {
-        //setup file name
-        char fileName[30];
-        memset(fileName, '\0', 30);
-        sprintf(fileName, DIRECTORY_PREFIX"%d/%s", pid, rooms[i]->name);
-
+    for (i = 0; i < roomCount && !isBinaryOnly; i++) {
         //create file
-        fileDescriptor = open(fileName, O_WRONLY | O_TRUNC | O_CREAT, 0777);
+        fileDescriptor = openat(directoryDescriptor, rooms[i].name, O_WRONLY | O_TRUNC | O_CREAT, 0777);
 
         if(fileDescriptor == -1)
             printf("Warning, file creation/opening went wrong!");
 
         //setup string content to write to file
-        char fileContent[200];
-        memset(fileContent, '\0', 200);
-        sprintf(fileContent, "ROOM NAME: %s\n", rooms[i]->name);
+        int length = sprintf(fileContent, "ROOM NAME: %s\n", rooms[i].name);
 
         //construction of "CONNECTION: <room name>"
         int j;
-        for (j = 0; j < rooms[i]->connectionCount; j++) {
-            char connectionContent[30];
-            memset(connectionContent, '\0', 30);
-            sprintf(connectionContent, "CONNECTION %d: %s\n", j + 1, rooms[i]->connection[j]->name);
-            strcat(fileContent, connectionContent);
-        }
+        for (j = 0; j < rooms[i].connectionCount; j++)
+            length += sprintf(fileContent + length, "CONNECTION %d: %s\n", j + 1, rooms[rooms[i].connection[j]].name);
 
-        char typeContent[30];
-        memset(typeContent, '\0', 30);
-        sprintf(typeContent, "ROOM TYPE: %s\n", rooms[i]->type);
-        strcat(fileContent, typeContent);
-
-//        printf(fileContent); //for debugging
-//        printf("\n\n");
+        length += sprintf(fileContent + length, "ROOM TYPE: %s\n", typeNames[rooms[i].type]);
 
         //write to file
-        ssize_t nwritten;
-        nwritten = write(fileDescriptor, fileContent, strlen(fileContent)*sizeof(char));
+        if (fileDescriptor != -1 && WriteAll(fileDescriptor, fileContent, length) == -1)
+            printf("Warning, writing room file %s went wrong!", rooms[i].name);
 
         //close file
         close(fileDescriptor);
     }
+
+    free(fileContent);
+    CreateWorldFile(directoryDescriptor, rooms);
+    close(directoryDescriptor);
+}
+
+//points the latest link at the finished directory. the new link is made under a temporary name and renamed over
+//the old one, so readers always find either the old or the new directory
+void PublishLatest(char *directoryName) {
+    char temporaryName[64];
+    snprintf(temporaryName, sizeof(temporaryName), LATEST_LINK".%d", (int) getpid());
+    unlink(temporaryName);
+    if (symlink(directoryName, temporaryName) == -1 || rename(temporaryName, LATEST_LINK) == -1) {
+        printf("Warning, latest rooms link went wrong!");
+        unlink(temporaryName);
+    }
 }
 
+//Writes the whole world as one binary file (see struct WorldHeader) that the adventure can mmap and use as is.
+//the file is laid out in one buffer and written with one write, under a temporary name and renamed, so a reader
+//never sees half a file
+void CreateWorldFile(int directoryDescriptor, struct Room *rooms) {
+    size_t nameBytes = 0, connectionCount = 0;
+    int i, j;
+    for (i = 0; i < roomCount; i++) {
+        nameBytes += strlen(rooms[i].name) + 1;
+        connectionCount += rooms[i].connectionCount;
+    }
+    if (nameBytes > UINT32_MAX || connectionCount > UINT32_MAX) {
+        printf("Warning, world too big for the world file!");
+        return;
+    }
 
-////E. Main Run
-int main() {
-    struct Room **rooms = SetupRooms();
+    size_t fileSize = sizeof(struct WorldHeader) + sizeof(uint32_t)*(2*((size_t) roomCount + 1) + connectionCount) +
+                      roomCount + nameBytes;
+    char *file = (char*) malloc(fileSize);
+    struct WorldHeader *header = (struct WorldHeader*) file;
+    uint32_t *nameOffsets = (uint32_t*) (header + 1);
+    uint32_t *adjacencyOffsets = nameOffsets + roomCount + 1;
+    uint32_t *adjacency = adjacencyOffsets + roomCount + 1;
+    uint8_t *types = (uint8_t*) (adjacency + connectionCount);
+    char *names = (char*) (types + roomCount);
+
+    memcpy(header->magic, WORLD_MAGIC, 4);
+    header->version = WORLD_VERSION;
+    header->roomCount = roomCount;
+    header->connectionCount = connectionCount;
+    header->nameBytes = nameBytes;
+    header->reserved = 0;
+
+    //names are back to back in namePool already; connections get packed without the unused slots
+    nameBytes = 0;
+    connectionCount = 0;
+    for (i = 0; i < roomCount; i++) {
+        nameOffsets[i] = nameBytes;
+        adjacencyOffsets[i] = connectionCount;
+        types[i] = rooms[i].type;
+        nameBytes += strlen(rooms[i].name) + 1;
+        for (j = 0; j < rooms[i].connectionCount; j++)
+            adjacency[connectionCount++] = rooms[i].connection[j];
+    }
+    nameOffsets[roomCount] = nameBytes;
+    adjacencyOffsets[roomCount] = connectionCount;
+    memcpy(names, namePool, nameBytes);
+
+    int fileDescriptor = openat(directoryDescriptor, WORLD_FILE".tmp", O_WRONLY | O_TRUNC | O_CREAT, 0666);
+    if (fileDescriptor == -1 || WriteAll(fileDescriptor, file, fileSize) == -1 ||
+        renameat(directoryDescriptor, WORLD_FILE".tmp", directoryDescriptor, WORLD_FILE) == -1)
+        printf("Warning, world file creation went wrong!");
+    if (fileDescriptor != -1)
+        close(fileDescriptor);
 
-//    for (int i = 0; i < ROOM_COUNT; i++) { //for debugging
-//        printf("%s ", rooms[i]->name);
-//    }
-//    printf("\n\n");
+    free(file);
+}
 
-    SetupAllConnections(rooms);
-    CreateRoomFiles(rooms);
+//write() until everything is out. returns 0 on success, -1 on error
+int WriteAll(int fileDescriptor, void *buffer, size_t length) {
+    size_t written = 0;
+    while (written < length) {
+        ssize_t count = write(fileDescriptor, (char*) buffer + written, length - written);
+        if (count <= 0)
+            return -1;
+        written += count;
+    }
+    return 0;
+}
 
-    //output for logic debugging check
-//    for (int j = 0; j < ROOM_COUNT; j++) {
-//        printf("Room %s has the following connections:\n", rooms[j]->name);
-//        for (int k = 0; k < rooms[j]->connectionCount; k++)
-//            printf("____connection %d: %s\n", k, rooms[j]->connection[k]->name);
-//        printf("Type: %s", rooms[j]->type);
-//        printf("\n\n");
-//    }
 
+////E. Functions to build a batch of worlds at once ---------------------------------------------------------------
+int BuildWorld(char *);
+uint64_t WorldSeed(uint64_t, int);
+void* BuildBatchWorlds(void *);
+int BuildBatch(uint64_t);
+
+//builds one world from the current randomState and writes it into directoryName. a single world's directory is
+//only made once the world is built, and a batch's (made beforehand) is removed if the build fails, so a failed
+//build leaves no empty rooms directory behind. returns 0, or -1 if the world couldn't be built
+int BuildWorld(char *directoryName) {
+    struct Room *rooms = SetupRooms();
+    int result = SetupAllConnections(rooms);
+    if (result == -1)
+        rmdir(directoryName);
+    else if (mkdir(directoryName, 0777) == -1 && errno != EEXIST) {
+        printf("Warning, directory went wrong!");
+        result = -1;
+    }
+    else
+        CreateRoomFiles(rooms, directoryName);
     FreeMemory(rooms);
+    return result;
+}
+
+//generator state for world k of a batch: the batch seed and k go through the splitmix64 mixer, so the worlds'
+//random streams are unrelated to each other and the same seed always gives the same batch
+uint64_t WorldSeed(uint64_t seed, int k) {
+    uint64_t z = seed + (uint64_t) (k + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+//thread function: builds the batch's worlds that are still left, one at a time
+void* BuildBatchWorlds(void *argument) {
+    struct Batch *batch = (struct Batch*) argument;
+    char directoryName[64];
+
+    while (1) {
+        pthread_mutex_lock(&batch->nextLock);
+        int k = batch->nextWorld++;
+        pthread_mutex_unlock(&batch->nextLock);
+        if (k >= batchCount)
+            return NULL;
+
+        snprintf(directoryName, sizeof(directoryName), "%s/"DIRECTORY_PREFIX"%d", batch->directoryName, k);
+        randomState = WorldSeed(batch->seed, k);
+        if (BuildWorld(directoryName) == -1) {
+            pthread_mutex_lock(&batch->nextLock);
+            batch->failedWorlds++;
+            pthread_mutex_unlock(&batch->nextLock);
+        }
+    }
+}
+
+//builds batchCount worlds into gel.batch.<pid>/gel.rooms.<k>, on batchThreads threads. the directories are all
+//made before the threads start, so the threads only write files. prints how many worlds a second that made.
+//returns 0, or -1 if the directories can't be made or a world couldn't be built
+int BuildBatch(uint64_t seed) {
+    struct Batch batch;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    snprintf(batch.directoryName, sizeof(batch.directoryName), BATCH_PREFIX"%d", (int) getpid());
+    if (mkdir(batch.directoryName, 0777) == -1) {
+        printf("Warning, directory went wrong!\n");
+        return -1;
+    }
+    char directoryName[64];
+    int k;
+    for (k = 0; k < batchCount; k++) {
+        snprintf(directoryName, sizeof(directoryName), "%s/"DIRECTORY_PREFIX"%d", batch.directoryName, k);
+        if (mkdir(directoryName, 0777) == -1) {
+            printf("Warning, directory went wrong!\n");
+            while (k-- > 0) {
+                snprintf(directoryName, sizeof(directoryName), "%s/"DIRECTORY_PREFIX"%d", batch.directoryName, k);
+                rmdir(directoryName);
+            }
+            rmdir(batch.directoryName);
+            return -1;
+        }
+    }
+
+    batch.seed = seed;
+    batch.nextWorld = 0;
+    batch.failedWorlds = 0;
+    pthread_mutex_init(&batch.nextLock, NULL);
+
+    int threadCount = batchThreads;
+    if (threadCount == 0)
+        threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threadCount > batchCount)
+        threadCount = batchCount;
+    if (threadCount > MAX_BATCH_THREADS)
+        threadCount = MAX_BATCH_THREADS;
+    if (threadCount < 1)
+        threadCount = 1;
+
+    //this thread builds too; the others are extra help
+    pthread_t threadIds[MAX_BATCH_THREADS];
+    int i, started = 0;
+    for (i = 1; i < threadCount; i++) {
+        if (pthread_create(&threadIds[started], NULL, BuildBatchWorlds, &batch) == 0)
+            started++;
+    }
+    BuildBatchWorlds(&batch);
+    for (i = 0; i < started; i++)
+        pthread_join(threadIds[i], NULL);
+    pthread_mutex_destroy(&batch.nextLock);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%d worlds of %d rooms in %s/ (seed %llu, threads %d): %.3f s, %.0f worlds/s\n", batchCount, roomCount,
+           batch.directoryName, (unsigned long long) seed, started + 1, seconds, batchCount / seconds);
+    if (batch.failedWorlds > 0) {
+        printf("%d worlds could not be built and were left out.\n", batch.failedWorlds);
+        return -1;
+    }
+    return 0;
+}
+
+
+////F. Main Run
+//usage: gel.buildrooms [-n rooms] [-m min connections] [-M max connections] [-s seed] [-b] [-k worlds [-j threads]]
+//defaults are the classic 7 rooms with 3 to 6 connections and a seed from the clock. the world is written both as
+//one text file per room and as a binary world file; -b leaves out the text files (for huge worlds).
+//-k builds that many worlds side by side on -j threads (default one per cpu), each from its own seed derived
+//from -s, into gel.batch.<pid>/gel.rooms.<k>; gel.latest is left alone
+int main(int argc, char *argv[]) {
+    randomState = (uint64_t) time(NULL) ^ ((uint64_t) getpid() << 32);
+
+    int option;
+    while ((option = getopt(argc, argv, "n:m:M:s:bk:j:")) != -1) {
+        switch (option) {
+            case 'n':
+                roomCount = atoi(optarg);
+                break;
+            case 'm':
+                minConnections = atoi(optarg);
+                break;
+            case 'M':
+                maxConnections = atoi(optarg);
+                break;
+            case 's':
+                randomState = strtoull(optarg, NULL, 0);
+                break;
+            case 'b':
+                isBinaryOnly = 1;
+                break;
+            case 'k':
+                batchCount = atoi(optarg);
+                if (batchCount < 1) {
+                    fprintf(stderr, "Invalid batch: need at least 1 world.\n");
+                    return 2;
+                }
+                break;
+            case 'j':
+                batchThreads = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n rooms] [-m min connections] [-M max connections] [-s seed] [-b] "
+                                "[-k worlds [-j threads]]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    //a room can't connect to more rooms than there are, and the cycle needs 2 connections per room
+    if (roomCount < 2 || minConnections < 1 || maxConnections < minConnections || maxConnections > roomCount - 1 ||
+        (roomCount > 2 && maxConnections < 2)) {
+        fprintf(stderr, "Invalid world: need at least 2 rooms and 1 <= min <= max <= rooms - 1 (max >= 2 past 2 rooms).\n");
+        return 2;
+    }
+    //with every room at exactly k connections, rooms * k has to be even as each connection has two ends
+    if (minConnections == maxConnections && roomCount % 2 == 1 && minConnections % 2 == 1) {
+        fprintf(stderr, "Invalid world: an odd number of rooms can't all have the same odd number of connections.\n");
+        return 2;
+    }
+
+    if (batchCount > 0)
+        return (BuildBatch(randomState) == 0) ? 0 : 1;
+
+    char directoryName[32];
+    snprintf(directoryName, sizeof(directoryName), DIRECTORY_PREFIX"%d", (int) getpid());
+    if (BuildWorld(directoryName) == -1)
+        return 1;
+    PublishLatest(directoryName);
     return 0;
 }
\ No newline at end of file